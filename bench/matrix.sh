@@ -0,0 +1,81 @@
+#!/bin/sh
+#
+# matrix.sh - Replay the trace set and the synthetic workloads through
+# each mm_*.c allocator, the C library's malloc, and any other malloc
+# found on this machine (through LD_PRELOAD). Prints one results.txt
+# style table per allocator, with latency, instruction, TLB and RSS columns.
+#
+# Usage: LAB=path/to/malloclab-handout bench/matrix.sh [trace.rep ...]
+# LAB must hold the handout's mm.h, memlib.c, memlib.h and config.h.
+# Traces default to the ones mdriver runs, from TRACEDIR ($LAB/traces).
+# The mm_*.c allocators keep 32 bit pointers, so they are built with
+# -m32 like the handout's Makefile. malloc is built natively, so that
+# the preloaded libraries match.
+#
+set -e
+cd "$(dirname "$0")/.."
+LAB=${LAB:-.}
+TRACEDIR=${TRACEDIR:-$LAB/traces}
+CC=${CC:-gcc}
+CFLAGS=${CFLAGS:--O2 -m32}
+SYS_CFLAGS=${SYS_CFLAGS:--O2}
+OUT=${OUT:-bench/out}
+PRELOAD_LIBS="jemalloc tcmalloc tcmalloc_minimal mimalloc hoard tbbmalloc_proxy"
+SYNTH="synth:small synth:mixed synth:grow"
+
+if [ $# -gt 0 ]; then
+  TRACES="$*"
+else
+  TRACES=
+  for t in amptjp-bal cccp-bal cp-decl-bal expr-bal coalescing-bal random-bal \
+           random2-bal binary-bal binary2-bal realloc-bal realloc2-bal; do
+    [ -f "$TRACEDIR/$t.rep" ] && TRACES="$TRACES $TRACEDIR/$t.rep"
+  done
+fi
+
+mkdir -p "$OUT"
+rm -f "$OUT"/tracebench-*
+$CC $SYS_CFLAGS -DSYSTEM_MALLOC -o "$OUT/tracebench-libc" bench/tracebench.c
+for src in mm_*.c; do
+  name=${src%.c}
+  $CC $CFLAGS -pthread -I"$LAB" -I. -o "$OUT/tracebench-$name" bench/tracebench.c "$src" "$LAB/memlib.c" \
+    || echo "matrix.sh: skipping $name, which doesn't build" >&2
+done
+
+# table NAME COMMAND... - One row per trace and a total row
+table() {
+  name=$1; shift
+  echo "Results for $name:"
+  first=1
+  for t in $TRACES $SYNTH; do
+    if [ $first = 1 ]; then "$@" -H "$t"; first=0; else "$@" "$t"; fi \
+      || echo "$(basename "$t" .rep) failed"
+  done | awk '
+    { print }
+    NF == 10 && $3 ~ /^[0-9]+$/ {
+      n++; ops += $3; secs += $4
+      if ($2 != "-") { util += $2; nutil++ }
+      if ($7 > p99) p99 = $7
+      if ($8 != "-") { insn += $8 * $3; insn_ops += $3 }
+      if ($9 != "-") { dtlb += $9 * $3; dtlb_ops += $3 }
+      if ($10 > rss) rss = $10
+    }
+    END {
+      if (n == 0) exit
+      printf "%-16s %5s %8d %9.6f %7.0f %6s %6d %8s %8s %8d\n", "Total",
+        nutil ? sprintf("%.0f%%", util / nutil) : "-", ops, secs, ops / secs / 1000,
+        "-", p99, insn_ops ? sprintf("%.1f", insn / insn_ops) : "-",
+        dtlb_ops ? sprintf("%.2f", dtlb / dtlb_ops) : "-", rss
+    }'
+  echo ___________________________________________
+}
+
+for bin in "$OUT"/tracebench-mm_*; do
+  [ -x "$bin" ] && table "${bin##*/tracebench-}" "$bin"
+done
+table libc "$OUT/tracebench-libc"
+for lib in $PRELOAD_LIBS; do
+  path=$(ldconfig -p 2>/dev/null | awk -v l="lib$lib.so" '$1 == l || index($1, l ".") == 1 { print $NF; exit }')
+  [ -n "$path" ] && table "$lib" env LD_PRELOAD="$path" "$OUT/tracebench-libc"
+done
+exit 0
@@ -0,0 +1,31 @@
+#!/bin/sh
+#
+# mt.sh - Build mtbench against each mm_*.c allocator and the C library's
+# malloc, and run them all.
+#
+# Usage: LAB=path/to/malloclab-handout bench/mt.sh [mtbench options]
+# LAB must hold the handout's mm.h, memlib.c, memlib.h and config.h.
+# The allocators keep 32 bit pointers, so CFLAGS default to -m32, like
+# the handout's Makefile. The results go to stdout as one CSV.
+#
+set -e
+cd "$(dirname "$0")/.."
+LAB=${LAB:-.}
+CC=${CC:-gcc}
+CFLAGS=${CFLAGS:--O2 -m32}
+OUT=${OUT:-bench/out}
+
+mkdir -p "$OUT"
+rm -f "$OUT"/mtbench-*
+$CC $CFLAGS -pthread -DSYSTEM_MALLOC -o "$OUT/mtbench-libc" bench/mtbench.c
+for src in mm_*.c; do
+  name=${src%.c}
+  $CC $CFLAGS -pthread -I"$LAB" -I. -DALLOCATOR="\"$name\"" \
+    -o "$OUT/mtbench-$name" bench/mtbench.c "$src" "$LAB/memlib.c" \
+    || echo "mt.sh: skipping $name, which doesn't build" >&2
+done
+
+echo scenario,allocator,threads,ops_per_sec,rss_kb
+for bin in "$OUT"/mtbench-*; do
+  "$bin" "$@" | sed 1d
+done
@@ -0,0 +1,432 @@
+/*
+ * mtbench.c - Multithreaded allocator benchmarks.
+ *
+ * Scenarios, after the classic allocator benchmarks:
+ *   threadtest  each thread allocates and frees batches of private objects;
+ *   larson      threads replace random objects in arrays that are passed
+ *               from thread to thread, so objects are freed by other threads;
+ *   xmalloc     producer threads allocate, consumer threads free;
+ *   falseshare  threads allocate small objects at the same time and write
+ *               them hard, which is slow if they share cache lines.
+ * Built with an mm_*.c file, every call takes one global lock, since none
+ * of the allocators are thread safe. Built with -DSYSTEM_MALLOC, the C
+ * library's malloc is measured instead.
+ *
+ * Usage: mtbench [-t max_threads] [-n ops_per_thread] [scenario ...]
+ * Runs each scenario at 1, 2, 4, ... up to max_threads threads and prints
+ * CSV: scenario,allocator,threads,ops_per_sec,rss_kb. An op is a malloc or
+ * a free. RSS is taken at the end of each run, before anything is freed.
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef SYSTEM_MALLOC
+#include "mm.h"
+#include "memlib.h"
+#endif
+
+#ifndef ALLOCATOR
+#ifdef SYSTEM_MALLOC
+#define ALLOCATOR "libc"
+#else
+#define ALLOCATOR "mm"
+#endif
+#endif
+
+#define MAX_THREADS 64
+#define DEFAULT_OPS 200000 /* Mallocs and frees per thread */
+#define BATCH 100 /* Objects per threadtest batch and per xmalloc transfer */
+#define LARSON_SLOTS 500 /* Live objects in each larson array */
+#define LARSON_ROUND 1000 /* Replacements before an array moves on */
+#define QUEUE_CAP (64*BATCH) /* Objects in flight from producers to consumers */
+#define SCRATCH_WRITES 1000 /* falseshare writes per object */
+
+struct worker {
+  pthread_t thread;
+  int id;
+  unsigned int seed;
+  long ops;   /* Ops to do, then ops done */
+  struct timespec t0, t1; /* When the work started and ended */
+};
+
+struct scenario {
+  const char *name;
+  void *(*run)(void *);
+  void (*setup)(int threads);
+  void (*teardown)(int threads);
+};
+
+static void begin(struct worker *w);
+static void end(struct worker *w, long ops);
+static void *bench_malloc(size_t size);
+static void bench_free(void *ptr);
+static void bench_reset(void);
+static unsigned int rnd(unsigned int *seed);
+static long rss_kb(void);
+static void *threadtest(void *arg);
+static void *larson(void *arg);
+static void larson_setup(int threads);
+static void larson_teardown(int threads);
+static void *xmalloc(void *arg);
+static void xmalloc_setup(int threads);
+static void *falseshare(void *arg);
+
+static const struct scenario scenarios[] = {
+  {"threadtest", threadtest, NULL, NULL},
+  {"larson", larson, larson_setup, larson_teardown},
+  {"xmalloc", xmalloc, xmalloc_setup, NULL},
+  {"falseshare", falseshare, NULL, NULL},
+};
+#define NSCENARIOS (sizeof(scenarios) / sizeof(scenarios[0]))
+
+static pthread_barrier_t start, done; // Workers and main, around the timed part.
+static int nthreads; // Workers in this run.
+
+#ifdef SYSTEM_MALLOC
+static void *bench_malloc(size_t size) { return malloc(size); }
+static void bench_free(void *ptr) { free(ptr); }
+static void bench_reset(void) { }
+#else
+static pthread_mutex_t mm_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void *bench_malloc(size_t size)
+{
+  void *ptr;
+  pthread_mutex_lock(&mm_lock);
+  ptr = mm_malloc(size);
+  pthread_mutex_unlock(&mm_lock);
+  return ptr;
+}
+
+static void bench_free(void *ptr)
+{
+  pthread_mutex_lock(&mm_lock);
+  mm_free(ptr);
+  pthread_mutex_unlock(&mm_lock);
+}
+
+/* bench_reset - Start each run on an empty heap, like mdriver does */
+static void bench_reset(void)
+{
+  mem_reset_brk();
+  if (mm_init() < 0) {
+    fprintf(stderr, "mm_init failed\n");
+    exit(1);
+  }
+}
+#endif
+
+int main(int argc, char **argv)
+{
+  int max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+  long ops = DEFAULT_OPS;
+  int opt, selected[NSCENARIOS] = {0}, any = 0;
+  struct worker workers[MAX_THREADS];
+
+  while ((opt = getopt(argc, argv, "t:n:")) != -1) {
+    if (opt == 't')
+      max_threads = atoi(optarg);
+    else if (opt == 'n')
+      ops = atol(optarg);
+    else {
+      fprintf(stderr, "usage: %s [-t max_threads] [-n ops_per_thread] [scenario ...]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (max_threads < 1)
+    max_threads = 1;
+  if (max_threads > MAX_THREADS)
+    max_threads = MAX_THREADS;
+  for (; optind < argc; optind++) {
+    unsigned int s;
+    for (s = 0; s < NSCENARIOS && strcmp(argv[optind], scenarios[s].name); s++)
+      ;
+    if (s == NSCENARIOS) {
+      fprintf(stderr, "unknown scenario %s\n", argv[optind]);
+      return 2;
+    }
+    selected[s] = any = 1;
+  }
+
+#ifndef SYSTEM_MALLOC
+  mem_init();
+#endif
+  printf("scenario,allocator,threads,ops_per_sec,rss_kb\n");
+  for (unsigned int s = 0; s < NSCENARIOS; s++) {
+    if (any && !selected[s])
+      continue;
+    for (nthreads = 1; ; nthreads = nthreads*2 < max_threads ? nthreads*2 : max_threads) {
+      double first = 0, last = 0;
+      long total = 0, rss;
+
+      bench_reset();
+      if (scenarios[s].setup)
+        scenarios[s].setup(nthreads);
+      pthread_barrier_init(&start, NULL, nthreads + 1);
+      pthread_barrier_init(&done, NULL, nthreads + 1);
+      for (int i = 0; i < nthreads; i++) {
+        workers[i].id = i;
+        workers[i].seed = 2463534242u + i;
+        workers[i].ops = ops;
+        pthread_create(&workers[i].thread, NULL, scenarios[s].run, &workers[i]);
+      }
+      pthread_barrier_wait(&start);
+      pthread_barrier_wait(&done);
+      rss = rss_kb();
+      /* From the first thread starting to the last one finishing */
+      for (int i = 0; i < nthreads; i++) {
+        double t0 = workers[i].t0.tv_sec + workers[i].t0.tv_nsec / 1e9;
+        double t1 = workers[i].t1.tv_sec + workers[i].t1.tv_nsec / 1e9;
+        pthread_join(workers[i].thread, NULL);
+        total += workers[i].ops;
+        if (i == 0 || t0 < first)
+          first = t0;
+        if (i == 0 || t1 > last)
+          last = t1;
+      }
+      if (scenarios[s].teardown)
+        scenarios[s].teardown(nthreads);
+      pthread_barrier_destroy(&start);
+      pthread_barrier_destroy(&done);
+
+      printf("%s,%s,%d,%.0f,%ld\n", scenarios[s].name, ALLOCATOR, nthreads, total / (last - first), rss);
+      fflush(stdout);
+      if (nthreads == max_threads)
+        break;
+    }
+  }
+  return 0;
+}
+
+/* begin - Wait for the other threads, then start the clock */
+static void begin(struct worker *w)
+{
+  pthread_barrier_wait(&start);
+  clock_gettime(CLOCK_MONOTONIC, &w->t0);
+}
+
+/* end - Stop the clock, then wait until main has taken the RSS */
+static void end(struct worker *w, long ops)
+{
+  clock_gettime(CLOCK_MONOTONIC, &w->t1);
+  w->ops = ops;
+  pthread_barrier_wait(&done);
+}
+
+/* rnd - xorshift32 */
+static unsigned int rnd(unsigned int *seed)
+{
+  unsigned int x = *seed;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return *seed = x;
+}
+
+/* rss_kb - Resident set size of the process */
+static long rss_kb(void)
+{
+  long size, resident = 0;
+  FILE *f = fopen("/proc/self/statm", "r");
+
+  if (f != NULL) {
+    if (fscanf(f, "%ld %ld", &size, &resident) != 2)
+      resident = 0;
+    fclose(f);
+  }
+  return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/*
+ * threadtest - Allocate a batch of objects, touch them and free them all,
+ *     over and over. Nothing is shared, so this measures contention alone.
+ */
+static void *threadtest(void *arg)
+{
+  struct worker *w = arg;
+  char *objs[BATCH];
+  long n = 0;
+
+  begin(w);
+  while (n < w->ops) {
+    for (int i = 0; i < BATCH; i++) {
+      objs[i] = bench_malloc(16 + rnd(&w->seed) % 240);
+      objs[i][0] = (char)i;
+    }
+    for (int i = 0; i < BATCH; i++)
+      bench_free(objs[i]);
+    n += 2*BATCH;
+  }
+  end(w, n);
+  return NULL;
+}
+
+/*
+ * Larson arrays wait in a FIFO between rounds, so each round a thread
+ * usually gets an array that another thread filled.
+ */
+static char **larson_arrays[MAX_THREADS];
+static char **larson_queue[MAX_THREADS];
+static unsigned int larson_head, larson_tail;
+static pthread_mutex_t larson_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void larson_setup(int threads)
+{
+  unsigned int seed = 88172645u;
+
+  for (int t = 0; t < threads; t++) {
+    larson_arrays[t] = malloc(LARSON_SLOTS * sizeof(char *));
+    for (int i = 0; i < LARSON_SLOTS; i++)
+      larson_arrays[t][i] = bench_malloc(16 + rnd(&seed) % 496);
+    larson_queue[t] = larson_arrays[t];
+  }
+  larson_head = 0;
+  larson_tail = threads;
+}
+
+static void larson_teardown(int threads)
+{
+  for (int t = 0; t < threads; t++) {
+    for (int i = 0; i < LARSON_SLOTS; i++)
+      bench_free(larson_arrays[t][i]);
+    free(larson_arrays[t]);
+  }
+}
+
+/*
+ * larson - Like a server whose connections move between worker threads:
+ *     take an array, replace random objects in it, pass it on.
+ */
+static void *larson(void *arg)
+{
+  struct worker *w = arg;
+  long n = 0;
+
+  begin(w);
+  while (n < w->ops) {
+    char **objs;
+    pthread_mutex_lock(&larson_lock);
+    objs = larson_queue[larson_head++ % nthreads];
+    pthread_mutex_unlock(&larson_lock);
+
+    for (int i = 0; i < LARSON_ROUND; i++) {
+      unsigned int slot = rnd(&w->seed) % LARSON_SLOTS;
+      bench_free(objs[slot]);
+      objs[slot] = bench_malloc(16 + rnd(&w->seed) % 496);
+      objs[slot][0] = (char)i;
+    }
+    n += 2*LARSON_ROUND;
+
+    pthread_mutex_lock(&larson_lock);
+    larson_queue[larson_tail++ % nthreads] = objs;
+    pthread_mutex_unlock(&larson_lock);
+  }
+  end(w, n);
+  return NULL;
+}
+
+/*
+ * The xmalloc queue is a ring of objects on their way from producers to
+ * consumers. With one thread, the producer frees its own batches.
+ */
+static char *queue[QUEUE_CAP];
+static unsigned int queue_head, queue_count;
+static int producers_left;
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_not_full = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t queue_not_empty = PTHREAD_COND_INITIALIZER;
+
+static void xmalloc_setup(int threads)
+{
+  queue_head = queue_count = 0;
+  producers_left = (threads + 1) / 2;
+}
+
+/*
+ * xmalloc - Even threads produce, odd threads consume. Every object is
+ *     freed by a different thread than the one that allocated it, and the
+ *     run allocates as many objects as the other scenarios do.
+ */
+static void *xmalloc(void *arg)
+{
+  struct worker *w = arg;
+  int producers = (nthreads + 1) / 2;
+  char *objs[BATCH];
+  long n = 0;
+
+  begin(w);
+  if (w->id % 2 == 0) {
+    long quota = w->ops / 2 * nthreads / producers;
+    while (n < quota) {
+      for (int i = 0; i < BATCH; i++) {
+        objs[i] = bench_malloc(16 + rnd(&w->seed) % 240);
+        objs[i][0] = (char)i;
+      }
+      n += BATCH;
+      if (nthreads == 1) {
+        for (int i = 0; i < BATCH; i++)
+          bench_free(objs[i]);
+        n += BATCH;
+        continue;
+      }
+      pthread_mutex_lock(&queue_lock);
+      while (queue_count + BATCH > QUEUE_CAP)
+        pthread_cond_wait(&queue_not_full, &queue_lock);
+      for (int i = 0; i < BATCH; i++)
+        queue[(queue_head + queue_count++) % QUEUE_CAP] = objs[i];
+      pthread_cond_signal(&queue_not_empty);
+      pthread_mutex_unlock(&queue_lock);
+    }
+    pthread_mutex_lock(&queue_lock);
+    producers_left--;
+    pthread_cond_broadcast(&queue_not_empty);
+    pthread_mutex_unlock(&queue_lock);
+  } else {
+    for (;;) {
+      int got = 0;
+      pthread_mutex_lock(&queue_lock);
+      while (queue_count == 0 && producers_left > 0)
+        pthread_cond_wait(&queue_not_empty, &queue_lock);
+      while (got < BATCH && queue_count > 0) {
+        objs[got++] = queue[queue_head];
+        queue_head = (queue_head + 1) % QUEUE_CAP;
+        queue_count--;
+      }
+      pthread_cond_broadcast(&queue_not_full);
+      pthread_mutex_unlock(&queue_lock);
+      if (got == 0)
+        break;
+      for (int i = 0; i < got; i++)
+        bench_free(objs[i]);
+      n += got;
+    }
+  }
+  end(w, n);
+  return NULL;
+}
+
+/*
+ * falseshare - Allocate an 8 byte object, write it SCRATCH_WRITES times
+ *     and free it. If the allocator gives threads neighboring objects,
+ *     their writes fight over the same cache line.
+ */
+static void *falseshare(void *arg)
+{
+  struct worker *w = arg;
+  long n = 0;
+
+  begin(w);
+  while (n < w->ops) {
+    volatile char *obj = bench_malloc(8);
+    for (int i = 0; i < SCRATCH_WRITES; i++)
+      obj[i % 8]++;
+    bench_free((void *)obj);
+    n += 2;
+  }
+  end(w, n);
+  return NULL;
+}
@@ -0,0 +1,73 @@
+/*
+ * rssbench.c - Check that MM_SCAVENGE makes resident memory follow live data.
+ *
+ * Usage: rssbench
+ * Allocates NBIG big blocks, each followed by a small block that is freed
+ * and one that is kept, so the big ones can't coalesce. Then it frees every
+ * other big block, interleaved with the small frees, which leaves big free
+ * blocks deep in the free list as well as at its head. Prints the peak RSS,
+ * the RSS after the frees and the live payload, in KB, and fails if the
+ * RSS after the frees is more than RSS_SLACK over what is live: at most
+ * SCAVENGE_INTERVAL bytes freed since the last pass may still be resident.
+ *
+ * Built with mm_best_fit.c, -DMM_SCAVENGE and the handout's memlib.c.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+#define NBIG 72 /* Big blocks allocated */
+#define BIG 100000 /* Size of a big block, above SCAVENGE_MIN (bytes) */
+#define SMALL 64 /* Size of the small blocks between them (bytes) */
+#define RSS_SLACK (1<<20) /* Freed bytes the scavenger may not have seen yet */
+
+static long rss_kb(void);
+
+int main(void)
+{
+  static char *big[NBIG], *freed[NBIG], *kept[NBIG];
+  long base, peak, after, live;
+
+  mem_init();
+  if (mm_init() < 0)
+    return 1;
+  base = rss_kb();
+  for (int i = 0; i < NBIG; i++) {
+    if ((big[i] = mm_malloc(BIG)) == NULL || (freed[i] = mm_malloc(SMALL)) == NULL
+        || (kept[i] = mm_malloc(SMALL)) == NULL) {
+      fprintf(stderr, "rssbench: out of memory\n");
+      return 1;
+    }
+    memset(big[i], i, BIG);
+    memset(freed[i], i, SMALL);
+    memset(kept[i], i, SMALL);
+  }
+  peak = rss_kb() - base;
+  for (int i = 0; i < NBIG; i++) {
+    if (i % 2)
+      mm_free(big[i]);
+    mm_free(freed[i]);
+  }
+  after = rss_kb() - base;
+  live = ((long)NBIG/2 * BIG + (long)NBIG * SMALL) / 1024;
+
+  printf("peak %ld KB, after frees %ld KB, live %ld KB\n", peak, after, live);
+  return after > live + RSS_SLACK/1024;
+}
+
+/* rss_kb - Resident set size from /proc/self/statm, or 0 if unknown */
+static long rss_kb(void)
+{
+  FILE *f = fopen("/proc/self/statm", "r");
+  long size, resident = 0;
+
+  if (f != NULL) {
+    if (fscanf(f, "%ld %ld", &size, &resident) != 2)
+      resident = 0;
+    fclose(f);
+  }
+  return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
@@ -0,0 +1,342 @@
+/*
+ * tracebench.c - Replay one allocation trace for the benchmark matrix.
+ *
+ * Usage: tracebench [-H] trace
+ * trace is an mdriver .rep file, or synth:NAME for a generated workload:
+ *   synth:small  sizes up to 256 bytes, allocated and freed at random;
+ *   synth:mixed  sizes spread over powers of two up to 64 KiB;
+ *   synth:grow   buffers grown by realloc in small steps, then freed.
+ * The trace is replayed twice on an empty heap. The first pass is timed as
+ * a whole and counts retired instructions and data TLB read misses with
+ * perf_event_open; the second times every call, for the latency
+ * percentiles, and writes every payload so that the peak RSS reflects what
+ * was live. Prints one row:
+ *   trace util ops secs Kops p50_ns p99_ns insn/op dtlb/Kop peak_rss_kb
+ * util is the peak of live payload bytes over the heap size, as in mdriver,
+ * and is only known for the mm_*.c allocators. The heap size comes from
+ * the allocator's mm_heapsize if it has one, since heaps that memlib didn't
+ * map have a mem_heapsize of 0. Counters that can't be read are printed as
+ * '-'. -H prints the header first.
+ *
+ * Built with an mm_*.c file and the handout's memlib.c, it measures that
+ * allocator. Built with -DSYSTEM_MALLOC, it measures malloc, which can be
+ * swapped with LD_PRELOAD.
+ */
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef SYSTEM_MALLOC
+#include "mm.h"
+#include "memlib.h"
+
+/* Only some allocators define it; a weak reference is NULL in the others */
+extern size_t mm_heapsize(void) __attribute__((weak));
+#endif
+
+#define SYNTH_IDS 2000 /* Live object slots in synthetic workloads */
+#define SYNTH_OPS 100000 /* Calls in synthetic workloads */
+#define GROW_STEP 64 /* Bytes each synth:grow realloc adds */
+#define GROW_MAX (1<<16) /* Size at which synth:grow frees a buffer */
+
+struct op {
+  char type;   /* 'a'lloc, 'r'ealloc or 'f'ree */
+  int id;
+  size_t size;
+};
+
+static int read_trace(const char *path);
+static int synth(const char *name);
+static void add_op(char type, int id, size_t size);
+static double replay(uint64_t *latency);
+static void reset(void);
+static int open_counter(unsigned int type, unsigned long long config);
+static uint64_t now_ns(void);
+static int cmp_u64(const void *a, const void *b);
+static unsigned int rnd(void);
+static struct op *ops; // The trace.
+static int nops, ops_cap, nids;
+static char **ptrs; // Block of each id, or NULL.
+static size_t *sizes; // Requested size of each id.
+static size_t peak; // Most payload bytes live at once, in the last replay.
+
+#ifdef SYSTEM_MALLOC
+#define bench_malloc malloc
+#define bench_realloc realloc
+#define bench_free free
+#else
+#define bench_malloc mm_malloc
+#define bench_realloc mm_realloc
+#define bench_free mm_free
+#endif
+
+int main(int argc, char **argv)
+{
+  int header = 0, fd[2];
+  const char *trace, *name;
+  uint64_t count, *latency;
+  long long counts[2] = {-1, -1}; /* Instructions, data TLB read misses */
+  double secs, util = -1;
+  struct rusage ru;
+  char buf[64];
+
+  if (argc > 1 && strcmp(argv[1], "-H") == 0) {
+    header = 1;
+    argc--, argv++;
+  }
+  if (argc != 2) {
+    fprintf(stderr, "usage: tracebench [-H] trace.rep|synth:NAME\n");
+    return 2;
+  }
+  trace = argv[1];
+  if (strncmp(trace, "synth:", 6) == 0 ? synth(trace + 6) : read_trace(trace)) {
+    fprintf(stderr, "tracebench: can't load %s\n", trace);
+    return 1;
+  }
+  ptrs = calloc(nids, sizeof(*ptrs));
+  sizes = calloc(nids, sizeof(*sizes));
+  latency = malloc(nops * sizeof(*latency));
+  if (ptrs == NULL || sizes == NULL || latency == NULL)
+    return 1;
+
+#ifndef SYSTEM_MALLOC
+  mem_init();
+#endif
+  reset();
+  fd[0] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+  fd[1] = open_counter(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB
+                       | PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+  for (int i = 0; i < 2; i++)
+    if (fd[i] >= 0) {
+      ioctl(fd[i], PERF_EVENT_IOC_RESET, 0);
+      ioctl(fd[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+  secs = replay(NULL);
+  for (int i = 0; i < 2; i++)
+    if (fd[i] >= 0) {
+      ioctl(fd[i], PERF_EVENT_IOC_DISABLE, 0);
+      if (read(fd[i], &count, sizeof(count)) == sizeof(count))
+        counts[i] = count;
+      close(fd[i]);
+    }
+#ifndef SYSTEM_MALLOC
+  size_t heapsize = mm_heapsize ? mm_heapsize() : mem_heapsize();
+  if (heapsize > 0)
+    util = (double)peak / heapsize;
+#endif
+  reset();
+  replay(latency);
+  qsort(latency, nops, sizeof(*latency), cmp_u64);
+  getrusage(RUSAGE_SELF, &ru);
+
+  if (header)
+    printf("%-16s %5s %8s %9s %7s %6s %6s %8s %8s %8s\n",
+           "trace", "util", "ops", "secs", "Kops", "p50ns", "p99ns", "insn/op", "dtlb/Kop", "peakKB");
+  name = strrchr(trace, '/') ? strrchr(trace, '/') + 1 : trace;
+  snprintf(buf, sizeof(buf), "%.*s", (int)strcspn(name, "."), name);
+  printf("%-16s ", buf);
+  if (util >= 0)
+    printf("%4.0f%% ", 100 * util);
+  else
+    printf("%5s ", "-");
+  printf("%8d %9.6f %7.0f %6llu %6llu ", nops, secs, nops / secs / 1000,
+         (unsigned long long)latency[nops / 2], (unsigned long long)latency[(long)nops * 99 / 100]);
+  if (counts[0] >= 0)
+    printf("%8.1f ", (double)counts[0] / nops);
+  else
+    printf("%8s ", "-");
+  if (counts[1] >= 0)
+    printf("%8.2f ", 1000.0 * counts[1] / nops);
+  else
+    printf("%8s ", "-");
+  printf("%8ld\n", ru.ru_maxrss);
+  return 0;
+}
+
+/*
+ * read_trace - Load an mdriver trace: a header with the suggested heap
+ *     size, the number of ids, the number of ops and a weight, then one
+ *     op per line.
+ */
+static int read_trace(const char *path)
+{
+  FILE *f = fopen(path, "r");
+  int heap, count, weight;
+  char type;
+
+  if (f == NULL || fscanf(f, "%d %d %d %d", &heap, &nids, &count, &weight) != 4) {
+    if (f != NULL)
+      fclose(f);
+    return -1;
+  }
+  while (fscanf(f, " %c", &type) == 1) {
+    int id;
+    size_t size = 0;
+    if (type == 'f' ? fscanf(f, "%d", &id) != 1 : fscanf(f, "%d %zu", &id, &size) != 2)
+      break;
+    if (id < 0 || id >= nids)
+      break;
+    add_op(type, id, size);
+  }
+  fclose(f);
+  return nops == count ? 0 : -1;
+}
+
+/*
+ * synth - Generate a synthetic workload. Each step picks a random slot and
+ *     allocates it if it's empty; otherwise it frees it, or grows it for
+ *     synth:grow.
+ */
+static int synth(const char *name)
+{
+  int kind = strcmp(name, "small") == 0 ? 0 : strcmp(name, "mixed") == 0 ? 1
+    : strcmp(name, "grow") == 0 ? 2 : -1;
+  size_t *live;
+
+  if (kind < 0)
+    return -1;
+  nids = SYNTH_IDS;
+  if ((live = calloc(nids, sizeof(*live))) == NULL)
+    return -1;
+  while (nops < SYNTH_OPS) {
+    int id = rnd() % nids;
+    if (live[id] == 0) {
+      live[id] = kind == 0 ? 1 + rnd() % 256 : kind == 1 ? 1 + rnd() % (1u << (rnd() % 17)) : GROW_STEP;
+      add_op('a', id, live[id]);
+    } else if (kind == 2 && live[id] < GROW_MAX) {
+      live[id] += GROW_STEP;
+      add_op('r', id, live[id]);
+    } else {
+      live[id] = 0;
+      add_op('f', id, 0);
+    }
+  }
+  free(live);
+  return 0;
+}
+
+static void add_op(char type, int id, size_t size)
+{
+  if (nops == ops_cap) {
+    ops_cap = ops_cap ? 2*ops_cap : 4096;
+    if ((ops = realloc(ops, ops_cap * sizeof(*ops))) == NULL)
+      exit(1);
+  }
+  ops[nops].type = type;
+  ops[nops].id = id;
+  ops[nops].size = size;
+  nops++;
+}
+
+/*
+ * replay - Run the trace once and return how long it took. With latency,
+ *     each call is timed on its own, and every payload is written between
+ *     calls. Whatever the trace leaves allocated is freed afterwards.
+ */
+static double replay(uint64_t *latency)
+{
+  size_t live = 0;
+  uint64_t start = now_ns();
+
+  peak = 0;
+  for (int i = 0; i < nops; i++) {
+    struct op *op = &ops[i];
+    uint64_t t0 = latency ? now_ns() : 0;
+    if (op->type == 'a') {
+      ptrs[op->id] = bench_malloc(op->size);
+      live += op->size;
+    } else if (op->type == 'r') {
+      ptrs[op->id] = bench_realloc(ptrs[op->id], op->size);
+      live += op->size - sizes[op->id];
+    } else {
+      if (ptrs[op->id] != NULL)
+        bench_free(ptrs[op->id]);
+      ptrs[op->id] = NULL;
+      live -= sizes[op->id];
+    }
+    if (latency)
+      latency[i] = now_ns() - t0;
+    if (op->type != 'f') {
+      if (ptrs[op->id] == NULL && op->size > 0) {
+        fprintf(stderr, "tracebench: out of memory at op %d\n", i);
+        exit(1);
+      }
+      sizes[op->id] = op->size;
+      if (latency)
+        memset(ptrs[op->id], i, op->size);
+    } else {
+      sizes[op->id] = 0;
+    }
+    if (live > peak)
+      peak = live;
+  }
+  double secs = (now_ns() - start) / 1e9;
+
+  for (int id = 0; id < nids; id++)
+    if (ptrs[id] != NULL) {
+      bench_free(ptrs[id]);
+      ptrs[id] = NULL;
+      sizes[id] = 0;
+    }
+  return secs;
+}
+
+/* reset - Start a replay on an empty heap, like mdriver does */
+static void reset(void)
+{
+#ifndef SYSTEM_MALLOC
+  mem_reset_brk();
+  if (mm_init() < 0) {
+    fprintf(stderr, "tracebench: mm_init failed\n");
+    exit(1);
+  }
+#endif
+}
+
+/*
+ * open_counter - A disabled counter of a user space event in this thread,
+ *     or -1 if perf events, or this one, aren't available.
+ */
+static int open_counter(unsigned int type, unsigned long long config)
+{
+  struct perf_event_attr attr;
+
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+/* rnd - xorshift32, fixed seed so every allocator gets the same workload */
+static unsigned int rnd(void)
+{
+  static unsigned int x = 2463534242u;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return x;
+}
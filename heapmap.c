@@ -0,0 +1,148 @@
+/*
+ * heapmap.c - Draw heap snapshots written by mm_heap_snapshot.
+ *
+ * Usage: heapmap file.bin [file.bin ...]
+ *
+ * For each snapshot, prints a summary, a map with one character per page
+ * showing how much of it is allocated, and a log2 histogram of free block
+ * sizes. Running it on snapshots taken at the same point of a trace with
+ * different allocators shows how each policy fragments the heap.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "mm_heapmap.h"
+
+#define MAP_WIDTH 64 /* Pages per line of the map */
+#define HIST_BUCKETS 32
+
+static int show(const char *path);
+static void show_map(struct heapmap_header *h, struct heapmap_block *blocks);
+static void show_free_sizes(struct heapmap_header *h, struct heapmap_block *blocks);
+
+int main(int argc, char **argv)
+{
+  int status = 0;
+
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s file.bin [file.bin ...]\n", argv[0]);
+    return 2;
+  }
+  for (int i = 1; i < argc; i++)
+    if (show(argv[i]) < 0)
+      status = 1;
+  return status;
+}
+
+static int show(const char *path)
+{
+  struct heapmap_header h;
+  struct heapmap_block *blocks;
+  unsigned long alloc_bytes = 0, free_bytes = 0, largest_free = 0;
+  unsigned int nfree = 0;
+  FILE *f;
+
+  if ((f = fopen(path, "rb")) == NULL) {
+    perror(path);
+    return -1;
+  }
+  if (fread(&h, sizeof(h), 1, f) != 1 || h.magic != HEAPMAP_MAGIC
+      || h.version != HEAPMAP_VERSION) {
+    fprintf(stderr, "%s: not a heap map\n", path);
+    fclose(f);
+    return -1;
+  }
+  if ((blocks = malloc(h.nblocks * sizeof(*blocks))) == NULL
+      || fread(blocks, sizeof(*blocks), h.nblocks, f) != h.nblocks) {
+    fprintf(stderr, "%s: truncated\n", path);
+    free(blocks);
+    fclose(f);
+    return -1;
+  }
+  fclose(f);
+
+  for (unsigned int i = 0; i < h.nblocks; i++) {
+    unsigned int size = blocks[i].size & ~0x7;
+    if (blocks[i].size & 0x1) {
+      alloc_bytes += size;
+    } else {
+      free_bytes += size;
+      nfree++;
+      if (size > largest_free)
+        largest_free = size;
+    }
+  }
+
+  printf("%s (%s)\n", path, h.policy);
+  printf("heap %u bytes, %u blocks, %lu allocated, %lu free in %u blocks\n",
+         h.heapsize, h.nblocks, alloc_bytes, free_bytes, nfree);
+  if (free_bytes)
+    printf("largest free block %lu bytes, %.1f%% of free space\n",
+           largest_free, 100.0 * largest_free / free_bytes);
+  show_map(&h, blocks);
+  show_free_sizes(&h, blocks);
+  printf("\n");
+  free(blocks);
+  return 0;
+}
+
+/*
+ * show_map - One character per page: '.' if nothing in it is allocated,
+ *     '#' if all of it is, and 1-9 for the allocated tenths in between.
+ */
+static void show_map(struct heapmap_header *h, struct heapmap_block *blocks)
+{
+  unsigned int npages = (h->heapsize + h->pagesize - 1) / h->pagesize;
+  unsigned int *used = calloc(npages ? npages : 1, sizeof(*used));
+
+  if (used == NULL)
+    return;
+  for (unsigned int i = 0; i < h->nblocks; i++) {
+    if (!(blocks[i].size & 0x1))
+      continue;
+    unsigned int lo = blocks[i].offset;
+    unsigned int hi = lo + (blocks[i].size & ~0x7);
+    while (lo < hi) {
+      unsigned int page = lo / h->pagesize;
+      unsigned int end = (page + 1) * h->pagesize;
+      if (end > hi)
+        end = hi;
+      used[page] += end - lo;
+      lo = end;
+    }
+  }
+
+  for (unsigned int page = 0; page < npages; page++) {
+    unsigned int tenths = (unsigned int)(10ULL * used[page] / h->pagesize);
+    if (page % MAP_WIDTH == 0)
+      printf("%s%08x ", page ? "\n" : "", page * h->pagesize);
+    if (used[page] == 0)
+      putchar('.');
+    else if (used[page] >= h->pagesize)
+      putchar('#');
+    else
+      putchar('0' + (tenths ? tenths : 1));
+  }
+  printf("\n");
+  free(used);
+}
+
+static void show_free_sizes(struct heapmap_header *h, struct heapmap_block *blocks)
+{
+  unsigned int count[HIST_BUCKETS] = {0};
+  unsigned long bytes[HIST_BUCKETS] = {0};
+
+  for (unsigned int i = 0; i < h->nblocks; i++) {
+    unsigned int size = blocks[i].size & ~0x7;
+    if (blocks[i].size & 0x1)
+      continue;
+    int b = 31 - __builtin_clz(size | 1);
+    count[b]++;
+    bytes[b] += size;
+  }
+  printf("free block sizes:\n");
+  for (int b = 0; b < HIST_BUCKETS; b++)
+    if (count[b])
+      printf("  [%10u, %10u) %8u blocks %12lu bytes\n",
+             1u << b, b < 31 ? 1u << (b + 1) : ~0u, count[b], bytes[b]);
+}
@@ -8,23 +8,87 @@
  * Best-fit policy;
  * Split when there's at least a min length left;
  * Coalesce both neighbors using header/footer;
- * Realloc uses malloc and free.
+ * Realloc uses malloc and free;
+ * With MM_MMAP, huge blocks get their own mapping and grow with mremap;
+ * With MM_REALLOC_INPLACE, realloc resizes in place and gives growing blocks slack;
+ * With MM_PLACE_HIGH, big blocks are split off the high side of free blocks;
+ * With MM_ADAPTIVE_GROW, the heap grows in steps that follow demand;
+ * With MM_HUGEPAGE, the heap is backed by transparent huge pages;
+ * With MM_SCAVENGE, pages inside big free blocks are returned to the OS;
+ * With MM_PROFILE, hot paths are timed (see mm_prof.h);
+ * Blocks allocated through handles can be moved by mm_compact;
+ * With MM_PERSIST, the heap is a file mapping that mm_open reattaches;
+ * With MM_ADAPTIVE_FIT, first/good/best fit is chosen as fragmentation grows;
+ * With MM_SIDE_INDEX, find_fit scans a compact array instead of the list;
+ * With MM_CHECK=n, calls check the next n blocks of the heap;
+ * With MM_SAMPLE=n, every n bytes or so an allocation's stack is sampled.
  */
+#if defined(MM_MMAP) || defined(MM_HUGEPAGE) || defined(MM_SCAVENGE) || defined(MM_PERSIST) \
+    || defined(MM_SIDE_INDEX) || defined(MM_SAMPLE)
+#define _GNU_SOURCE
+#include <sys/mman.h>
+#endif
+#ifdef MM_PERSIST
+#if defined(MM_HUGEPAGE) || defined(MM_MMAP)
+#error "MM_PERSIST keeps the whole heap in one file mapping"
+#endif
+#ifdef MM_SIDE_INDEX
+#error "MM_SIDE_INDEX changes the block layout and keeps the index outside the file"
+#endif
+#ifdef MM_SCAVENGE
+#error "MADV_DONTNEED on a shared file mapping keeps the data, so purged blocks aren't zero"
+#endif
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
+#if defined(MM_ADAPTIVE_FIT) && defined(MM_SIDE_INDEX)
+/* The index scan is sequential and reads no blocks, so it is always best fit */
+#undef MM_ADAPTIVE_FIT
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <unistd.h>
 #include <string.h>
+#if defined(MM_SIDE_INDEX) && defined(__AVX2__)
+#include <immintrin.h>
+#endif
 
 #include "mm.h"
 #include "memlib.h"
+#include "mm_heapmap.h"
+#include "mm_ext.h"
+#include "mm_prof.h"
+#include "mm_sample.h"
 
 team_t team = {"ateam", "Lucas", "fake@email.com", "", ""};
 
 #define WSIZE 4 /* Word and header/footer size (bytes) */
 #define DSIZE 8 /* Double word size (bytes) */
-#define CHUNKSIZE (1<<12) /* Extend heap by this amount (bytes) */
+#define CHUNKSIZE (1<<12) /* Extend heap by at least this amount (bytes) */
+#define MAX_CHUNKSIZE (1<<14) /* Cap for the adaptive heap growth step (bytes) */
+#define GROWTH_WINDOW 32 /* Extensions this many mallocs apart mean sustained demand */
+#define SPLIT_HIGH 96 /* Blocks this big are placed at the high end of a free block */
+#define GROW_STREAK 3 /* Reallocs that grow a block in a row before it gets slack */
+#define MMAP_THRESHOLD (1<<17) /* Requests this big get their own mapping (bytes) */
+#define HUGEPAGE_SIZE (1<<21) /* Huge page backed heaps are committed in these steps */
+#ifndef HEAP_RESERVE
+#define HEAP_RESERVE (1<<30) /* Address range reserved for a huge page backed heap */
+#endif
+#define PERSIST_BASE 0x40000000UL /* Fixed address of a persistent heap */
+#define PERSIST_SIZE (1<<28) /* Size of the file backing a persistent heap */
+#define PERSIST_MAGIC 0x50504d4d /* "MMPP" */
+#define FIT_EPOCH 256 /* find_fit calls between fit policy decisions */
+#define GOOD_FIT_K 8 /* Fitting candidates a good fit compares */
+#define FRAG_LOW 10 /* Below this percentage of free heap, first fit is enough */
+#define FRAG_STEP 2 /* Drop in free heap percentage that ends a best fit run */
+#define SEARCH_COST_MAX 64 /* Mean free blocks visited above which best fit is too slow */
+#define INDEX_CAP (1<<24) /* Free blocks the side index can hold */
+#define SCAVENGE_MIN (1<<16) /* Free blocks this big get their pages purged (bytes) */
+#define SCAVENGE_INTERVAL (1<<20) /* Bytes freed between scavenger passes */
+#define SCAVENGE_BUDGET 16 /* Blocks purged per scavenger pass */
 #define MAX(x, y) ((x) > (y)? (x) : (y))
+#define MIN(x, y) ((x) < (y)? (x) : (y))
 /* Pack a size and allocated bit into a word */
 #define PACK(size, alloc, prev_alloc) ((size) | (alloc) | (prev_alloc << 1))
 /* Read and write a word at address p */
@@ -34,56 +98,296 @@ team_t team = {"ateam", "Lucas", "fake@email.com", "", ""};
 #define GET_SIZE(p) (GET_WORD(p) & ~0x7)
 #define GET_ALLOC(p) (GET_WORD(p) & 0x1)
 #define GET_PREV_ALLOC(p) ((GET_WORD(p) & 0x2) >> 1)
+/* Allocated blocks that live in their own mapping, outside the heap */
+#define MMAPPED 0x4
+#define GET_MMAPPED(p) (GET_WORD(p) & MMAPPED)
+/* Free blocks whose interior pages were purged and now read as zero */
+#define PURGED 0x4
+#define GET_PURGED(p) (GET_WORD(p) & PURGED)
 /* Given block ptr bp, compute address of its header and footer */
 #define HDRP(bp) ((char *)(bp) - WSIZE)
 #define FTRP(bp) ((char *)(bp) + GET_SIZE(HDRP(bp)) - DSIZE)
 /* Given free block ptr bp, compute address of its pred and succ fields */
 #define PRED(bp) ((char *)(bp))
 #define SUCC(bp) ((char *)(bp) + WSIZE)
+#ifdef MM_SIDE_INDEX
+/* Free blocks also hold their position in the side index */
+#define INDEXP(bp) ((char *)(bp) + DSIZE)
+#define LINKS_SIZE (3*WSIZE)
+#define MIN_BLOCK (3*DSIZE)
+#else
+#define LINKS_SIZE DSIZE
+#define MIN_BLOCK (2*DSIZE)
+#endif
+/*
+ * A handle names a block that mm_compact may move while it's unlocked.
+ * Handle blocks start with a hidden double word holding their slot, so
+ * the compactor can find the slot to update. A block is a handle block
+ * iff the slot it names points back at it.
+ */
+struct handle {
+  char *bp;          /* Block, or NULL if the slot is unused */
+  unsigned int pins; /* Lock count, or the next unused slot plus one */
+};
+/*
+ * A persistent heap starts with a page holding the allocator's state as of
+ * the last mm_sync. The rest of the page is unused, and the heap follows.
+ */
+struct persist_header {
+  unsigned int magic;
+  unsigned int clean; /* Nothing changed since the last mm_sync */
+  char *heap_listp;
+  char *free_list;
+  char *heap_brk;
+  size_t chunksize;
+  size_t free_bytes;
+  struct handle *handles;
+  unsigned int handles_cap;
+  unsigned int handles_free;
+  void *root;         /* Entry point to the application's data */
+};
 /* Given block ptr bp, compute address of next and previous blocks */
 #define NEXT_BLKP(bp) ((char *)(bp) + GET_SIZE(((char *)(bp) - WSIZE)))
 #define PREV_BLKP(bp) ((char *)(bp) - GET_SIZE(((char *)(bp) - DSIZE)))
 
 static void *extend_heap(size_t words);
+static size_t extend_size(size_t asize);
 static void *find_fit(size_t asize);
-static void place(void *bp, size_t asize);
+static void *place(void *bp, size_t asize);
 static void *coalesce(void *bp);
+static void push(char *bp);
+static size_t adjust_size(size_t size);
+static void *resize(void *bp, size_t asize, size_t acap);
+static void *place_top(size_t asize);
+static void *move_block(void *oldptr, void *newptr, size_t size);
+#ifdef MM_MMAP
+static void *mmap_block(size_t size);
+static void *mremap_block(void *bp, size_t size);
+static void *realloc_mapped(void *ptr, size_t size, size_t cap);
+#endif
+static void *heap_sbrk(size_t incr);
+static void close_gap(char *bp, size_t size);
+#ifdef MM_SCAVENGE
+static void scavenge(void);
+static size_t freed_since_scavenge; // Bytes freed since the last pass.
+static char *scavenge_cursor; // Next free block to look at, or NULL to start over.
+static char *zero_lo, *zero_hi; // Part of the last placed block known to be zero.
+/* A block leaving the free list hands the cursor to the block after it */
+#define SCAVENGE_UNLINK(bp, to) do { if (scavenge_cursor == (bp)) scavenge_cursor = (to); } while (0)
+#define SCAVENGE_RESTART() do { scavenge_cursor = NULL; } while (0)
+#else
+#define SCAVENGE_UNLINK(bp, to) do { } while (0)
+#define SCAVENGE_RESTART() do { } while (0)
+#endif
 static char *heap_listp; // Points to prologue block.
 static char *free_list; // Points to start of the free list.
+static char *heap_brk; // Points one past the epilogue header.
+static size_t chunksize; // Current heap growth step.
+static unsigned int mallocs_since_extend; // Demand since the last heap growth.
+static size_t free_bytes; // Sum of free block sizes.
+#ifdef MM_REALLOC_INPLACE
+static char *grow_bp; // Block returned by the last growing realloc.
+static size_t grow_size; // Size it was asked for.
+static unsigned int grow_streak; // Times in a row that block grew.
+#endif
+#ifdef MM_ADAPTIVE_FIT
+enum fit_policy { FIRST_FIT, GOOD_FIT, BEST_FIT };
+static void adapt_fit(void);
+static enum fit_policy fit_policy; // Placement policy for this epoch.
+static unsigned int fit_calls; // find_fit calls in this epoch.
+static unsigned int fit_visits; // Free blocks visited in this epoch.
+static unsigned int last_frag; // Percentage of free heap at the last decision.
+#endif
+static struct handle *handles; // Handle table, itself a block in the heap.
+static unsigned int handles_cap; // Slots in the handle table.
+static unsigned int handles_free; // First unused slot plus one, or 0.
+#ifdef MM_PERSIST
+static struct persist_header *persist; // Start of the file mapping.
+static void persist_dirty(void);
+#define PERSIST_DIRTY() do { if (persist->clean) persist_dirty(); } while (0)
+#else
+#define PERSIST_DIRTY() do { } while (0)
+#endif
+#ifdef MM_SIDE_INDEX
+static void index_reset(void);
+static void index_add(char *bp);
+static void index_del(char *bp);
+static void index_update(char *bp);
+static char *index_fit(size_t asize);
+static unsigned int *index_sizes; // Size of each indexed free block.
+static unsigned int *index_blocks; // The free blocks, as 32 bit pointers.
+static unsigned int index_count; // Entries in use.
+#else
+#define index_reset() do { } while (0)
+#define index_add(bp) do { } while (0)
+#define index_del(bp) do { } while (0)
+#define index_update(bp) do { } while (0)
+#endif
+#ifdef MM_HUGEPAGE
+static char *heap_base; // Start of the reserved range.
+static char *heap_committed; // End of the readable and writable part.
+#endif
+#ifdef MM_PLACE_HIGH
+/* Whether place puts a block at the high end of the free block it splits */
+#define PLACE_HIGH(asize) ((asize) >= SPLIT_HIGH)
+#else
+#define PLACE_HIGH(asize) 0
+#endif
+#ifdef MM_CHECK
+#ifndef MM_CHECK_PERIOD
+#define MM_CHECK_PERIOD 1 /* Calls per check_step */
+#endif
+static void check_step(void);
+static void check_fail(char *bp, const char *what);
+static char *check_cursor; // Next block to check, or NULL to start over.
+static unsigned long check_calls; // Calls to mm_malloc and mm_free.
+#define CHECK_STEP() check_step()
+/* A block merged into the one before it hands the cursor to that block */
+#define CHECK_ABSORB(bp, into) do { if (check_cursor == (bp)) check_cursor = (into); } while (0)
+#define CHECK_RESTART() do { check_cursor = NULL; } while (0)
+#else
+#define CHECK_STEP() do { } while (0)
+#define CHECK_ABSORB(bp, into) do { } while (0)
+#define CHECK_RESTART() do { } while (0)
+#endif
 
 /* 
  * mm_init - initialize the malloc package.
  */
 int mm_init(void)
 {
+#ifdef MM_HUGEPAGE
+    /* Reuse the reserved range from a previous run */
+    heap_brk = heap_base;
+#endif
+#ifdef MM_PERSIST
+    /* Start over after the header page; mm_open maps the file */
+    if (persist == NULL)
+      return -1;
+    PERSIST_DIRTY();
+    persist->root = NULL;
+    heap_brk = (char *)persist + mem_pagesize();
+#endif
+    CHECK_RESTART();
+    SCAVENGE_RESTART();
+    SAMPLE_RESET();
     /* Create the initial empty heap */
-    if ((heap_listp = mem_sbrk(4*WSIZE)) == (void *)-1)
+    if ((heap_listp = heap_sbrk(4*WSIZE)) == (void *)-1)
       return -1;
     PUT_WORD(heap_listp, 0);                             /* Alignment padding */
     PUT_WORD(heap_listp + (1*WSIZE), PACK(DSIZE, 1, 0)); /* Prologue header */
     PUT_WORD(heap_listp + (3*WSIZE), PACK(0, 1, 1));     /* Epilogue header */
     heap_listp += (2*WSIZE);
+    chunksize = CHUNKSIZE;
+    mallocs_since_extend = 0;
+    free_bytes = 0;
+#ifdef MM_REALLOC_INPLACE
+    grow_bp = NULL;
+    grow_size = 0;
+    grow_streak = 0;
+#endif
+#ifdef MM_ADAPTIVE_FIT
+    fit_policy = BEST_FIT;
+    fit_calls = fit_visits = last_frag = 0;
+#endif
+#ifdef MM_SCAVENGE
+    freed_since_scavenge = 0;
+#endif
+    handles = NULL;
+    handles_cap = handles_free = 0;
+#ifdef MM_SIDE_INDEX
+    /* The index arrays are reserved once and reused by later runs */
+    if (index_sizes == NULL) {
+      char *p = mmap(NULL, 2 * INDEX_CAP * sizeof(unsigned int), PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+      if (p == MAP_FAILED)
+        return -1;
+      index_sizes = (unsigned int *)p;
+      index_blocks = index_sizes + INDEX_CAP;
+    }
+#endif
+    index_reset();
     
     /* Extend the empty heap with a free block of CHUNKSIZE bytes */
     if (extend_heap(CHUNKSIZE/WSIZE) == NULL)
       return -1;
 
     /* Initiallize the free list */
-    free_list = heap_listp + (2*WSIZE);
-    PUT_WORD(PRED(free_list), (unsigned int) NULL);
-    PUT_WORD(SUCC(free_list), (unsigned int) NULL);
+    free_list = NULL;
+    push(heap_listp + (2*WSIZE));
 
     return 0;
 }
 
+/*
+ * heap_sbrk - Grow the heap by incr bytes and return the old break, like
+ *     mem_sbrk. With MM_HUGEPAGE, the heap lives in a range reserved on first
+ *     use and aligned to HUGEPAGE_SIZE. It is made accessible in whole huge
+ *     pages, so each step can be backed by one huge page. MM_HUGETLB asks for
+ *     hugetlbfs pages instead of transparent ones. With MM_PERSIST, the
+ *     heap grows inside the file mapping.
+ */
+static void *heap_sbrk(size_t incr)
+{
+  char *old_brk;
+
+#ifdef MM_HUGEPAGE
+  if (heap_base == NULL) {
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+#ifdef MM_HUGETLB
+    /* hugetlbfs mappings are already aligned to the huge page size */
+    if ((heap_base = mmap(NULL, HEAP_RESERVE, PROT_NONE, flags | MAP_HUGETLB,
+                          -1, 0)) == MAP_FAILED) {
+      heap_base = NULL;
+      return (void *)-1;
+    }
+#else
+    /* Over-reserve, then trim both ends to reach an aligned range */
+    char *p;
+    if ((p = mmap(NULL, HEAP_RESERVE + HUGEPAGE_SIZE, PROT_NONE, flags,
+                  -1, 0)) == MAP_FAILED)
+      return (void *)-1;
+    heap_base = (char *)(((unsigned long)p + (HUGEPAGE_SIZE-1)) & ~(unsigned long)(HUGEPAGE_SIZE-1));
+    if (heap_base != p)
+      munmap(p, heap_base - p);
+    munmap(heap_base + HEAP_RESERVE, (p + HUGEPAGE_SIZE) - heap_base);
+#endif
+    heap_brk = heap_committed = heap_base;
+  }
+
+  if (incr > (size_t)(heap_base + HEAP_RESERVE - heap_brk))
+    return (void *)-1;
+  if (heap_brk + incr > heap_committed) {
+    size_t grow = (heap_brk + incr - heap_committed + (HUGEPAGE_SIZE-1)) & ~(HUGEPAGE_SIZE-1);
+    if (mprotect(heap_committed, grow, PROT_READ | PROT_WRITE) == -1)
+      return (void *)-1;
+#ifndef MM_HUGETLB
+    madvise(heap_committed, grow, MADV_HUGEPAGE);
+#endif
+    heap_committed += grow;
+  }
+  old_brk = heap_brk;
+#elif defined(MM_PERSIST)
+  if (incr > (size_t)((char *)persist + PERSIST_SIZE - heap_brk))
+    return (void *)-1;
+  old_brk = heap_brk;
+#else
+  if ((old_brk = mem_sbrk(incr)) == (void *)-1)
+    return (void *)-1;
+#endif
+  heap_brk = old_brk + incr;
+  return old_brk;
+}
+
 static void *extend_heap(size_t words)
 {
+  PROF_SCOPE(PROF_EXTEND_HEAP);
   char *bp;
   size_t size;
 
   /* Allocate an even number of words to maintain alignment */
   size = (words % 2) ? (words+1) * WSIZE : words * WSIZE;
-  if ((long)(bp = mem_sbrk(size)) == -1)
+  if ((long)(bp = heap_sbrk(size)) == -1)
     return NULL;
 
   int prev_alloc = GET_PREV_ALLOC(HDRP(bp));
@@ -92,17 +396,50 @@ static void *extend_heap(size_t words)
   PUT_WORD(HDRP(bp), PACK(size, 0, prev_alloc)); /* Free block header */
   PUT_WORD(FTRP(bp), PACK(size, 0, prev_alloc)); /* Free block footer */
   PUT_WORD(HDRP(NEXT_BLKP(bp)), PACK(0, 1, 0));  /* New epilogue header */
+  free_bytes += size;
 
   /* Coalesce if the previous block was free */
   return coalesce(bp);
 }
 
+/*
+ * extend_size - How much to grow the heap so a block of asize bytes fits.
+ *     With MM_ADAPTIVE_GROW, the step doubles while extensions come in quick
+ *     succession and halves for every quiet GROWTH_WINDOW, and since a free
+ *     block at the top of the heap will be coalesced with the new memory,
+ *     only the missing part is requested. Otherwise it is CHUNKSIZE.
+ */
+static size_t extend_size(size_t asize)
+{
+#ifdef MM_ADAPTIVE_GROW
+  char *epilogue = heap_brk - WSIZE;
+  size_t top = 0;
+
+  if (mallocs_since_extend < GROWTH_WINDOW)
+    chunksize = MIN(2*chunksize, MAX_CHUNKSIZE);
+  else
+    chunksize = MAX(chunksize >> MIN(mallocs_since_extend/GROWTH_WINDOW, 31), CHUNKSIZE);
+  mallocs_since_extend = 0;
+
+  /* The epilogue knows if the last block is free, and its footer precedes it */
+  if (!GET_PREV_ALLOC(epilogue))
+    top = GET_SIZE(epilogue - WSIZE);
+  return MAX(asize, chunksize) - top;
+#else
+  return MAX(asize, CHUNKSIZE);
+#endif
+}
+
 /* 
  * mm_malloc - Allocate a block by incrementing the brk pointer.
  *     Always allocate a block whose size is a multiple of the alignment.
  */
 void *mm_malloc(size_t size)
 {
+  PROF_SCOPE(PROF_MALLOC);
+  HEAPMAP_TICK();
+  CHECK_STEP();
+  PERSIST_DIRTY();
   /* This is the default implementation
   int newsize = ALIGN(size + SIZE_T_SIZE);
   void *p = mem_sbrk(newsize);
@@ -120,44 +457,78 @@ void *mm_malloc(size_t size)
   /* Ignore spurious requests */
   if (size == 0)
     return NULL;
+  mallocs_since_extend++;
+
+#ifdef MM_MMAP
+  /* Huge requests bypass the heap */
+  if (size >= MMAP_THRESHOLD) {
+    bp = mmap_block(size);
+    SAMPLE_ALLOC(bp, size);
+    return bp;
+  }
+#endif
   
   /* Adjust block size to include overhead and alignment reqs. */
-  if (size <= DSIZE)
-    asize = 2*DSIZE;
-  else
-    asize = DSIZE * ((size + (WSIZE) + (DSIZE-1)) / DSIZE);
+  asize = adjust_size(size);
   
   /* Search the free list for a fit */
   if ((bp = find_fit(asize)) != NULL) {
-    place(bp, asize);
+    bp = place(bp, asize);
+    SAMPLE_ALLOC(bp, size);
     return bp;
   }
 
   /* No fit found. Get more memory and place the block */
-  extendsize = MAX(asize,CHUNKSIZE);
+  extendsize = extend_size(asize);
   if ((bp = extend_heap(extendsize/WSIZE)) == NULL)
     return NULL;
   
   /* Add new node to the doubly linked list using LIFO */
-  if (free_list != NULL) PUT_WORD(PRED(free_list), (unsigned int) bp);
-  PUT_WORD(SUCC(bp), (unsigned int) free_list);
-  PUT_WORD(PRED(bp), (unsigned int) NULL);
-  free_list = bp;
+  push(bp);
 
-  place(bp, asize);
+  bp = place(bp, asize);
+  SAMPLE_ALLOC(bp, size);
   return bp;
 }
 
+/* adjust_size - Block size for a payload of size bytes */
+static size_t adjust_size(size_t size)
+{
+  if (size <= MIN_BLOCK - WSIZE)
+    return MIN_BLOCK;
+  return DSIZE * ((size + (WSIZE) + (DSIZE-1)) / DSIZE);
+}
+
 static void *find_fit(size_t asize)
 {
+  PROF_SCOPE(PROF_FIND_FIT);
+#ifdef MM_ADAPTIVE_FIT
+  unsigned int candidates = 0;
+  if (++fit_calls == FIT_EPOCH)
+    adapt_fit();
+#endif
+#ifdef MM_SIDE_INDEX
+  return index_fit(asize);
+#endif
   // "Best-fit" policy:
   char *best_fit = NULL;
   unsigned int best_diff = __UINT32_MAX__;
   for (char *bp = free_list; bp != NULL; bp = (char *) GET_WORD(SUCC(bp))) {
+    PROF_VISIT();
+#ifdef MM_ADAPTIVE_FIT
+    fit_visits++;
+#endif
     unsigned int size = GET_SIZE(HDRP(bp));
     if (asize == size)
       return bp;
     if (asize < size) {
+#ifdef MM_ADAPTIVE_FIT
+      // "First-fit" takes it, "good-fit" only compares the first few
+      if (fit_policy == FIRST_FIT)
+        return bp;
+      if (fit_policy == GOOD_FIT && ++candidates > GOOD_FIT_K)
+        break;
+#endif
       unsigned int diff = size - asize;
       int better_diff = best_diff < diff ? 0 : 1;
       best_diff = better_diff ? diff : best_diff;
@@ -167,25 +538,190 @@ static void *find_fit(size_t asize)
   return best_fit;
 }
 
-static void place(void *bp, size_t asize)
+#ifdef MM_ADAPTIVE_FIT
+/*
+ * adapt_fit - At the end of each epoch, pick how hard find_fit searches.
+ *     While less than FRAG_LOW percent of the heap is free, first fit is
+ *     enough. Above that, good fit is the floor, and best fit is tried
+ *     while fragmentation grows. Best fit is dropped once fragmentation
+ *     falls again, or when its searches visit too many blocks.
+ */
+static void adapt_fit(void)
+{
+  size_t heapsize = heap_brk - heap_listp;
+  // In 64 bits, as 100 * free_bytes overflows a 32 bit size_t past 42 MB
+  unsigned int frag = heapsize ? 100ULL * free_bytes / heapsize : 0;
+  unsigned int cost = fit_visits / FIT_EPOCH;
+
+  if (frag < FRAG_LOW)
+    fit_policy = FIRST_FIT;
+  else if (fit_policy == FIRST_FIT)
+    fit_policy = GOOD_FIT;
+  else if (fit_policy == GOOD_FIT && frag > last_frag)
+    fit_policy = BEST_FIT;
+  else if (fit_policy == BEST_FIT && (frag + FRAG_STEP < last_frag || cost > SEARCH_COST_MAX))
+    fit_policy = GOOD_FIT;
+  last_frag = frag;
+  fit_calls = fit_visits = 0;
+}
+#endif
+
+#ifdef MM_SIDE_INDEX
+/*
+ * The side index keeps the size of every free block, and the block
+ * itself, in two arrays that find_fit scans without touching the heap.
+ * Each free block holds its position in the arrays, so it can be removed
+ * by moving the last entry into its place.
+ */
+static void index_reset(void)
+{
+  index_count = 0;
+}
+
+static void index_add(char *bp)
+{
+  // A block left out of a full index can't be found, but it still coalesces
+  if (index_count == INDEX_CAP) {
+    PUT_WORD(INDEXP(bp), INDEX_CAP);
+    return;
+  }
+  index_sizes[index_count] = GET_SIZE(HDRP(bp));
+  index_blocks[index_count] = (unsigned int) bp;
+  PUT_WORD(INDEXP(bp), index_count++);
+}
+
+static void index_del(char *bp)
+{
+  unsigned int i = GET_WORD(INDEXP(bp));
+  if (i == INDEX_CAP)
+    return;
+  index_count--;
+  index_sizes[i] = index_sizes[index_count];
+  index_blocks[i] = index_blocks[index_count];
+  PUT_WORD(INDEXP(index_blocks[i]), i);
+}
+
+/* index_update - Refresh the entry of a block that changed size or moved */
+static void index_update(char *bp)
+{
+  unsigned int i = GET_WORD(INDEXP(bp));
+  if (i == INDEX_CAP)
+    return;
+  index_sizes[i] = GET_SIZE(HDRP(bp));
+  index_blocks[i] = (unsigned int) bp;
+}
+
+/*
+ * index_fit - Find the smallest indexed block of at least asize bytes.
+ *     With AVX2, eight sizes are compared at a time, keeping a running
+ *     minimum per lane, along with where it was found. Block sizes are
+ *     below 2^31, so the signed compares are safe.
+ */
+static char *index_fit(size_t asize)
+{
+  unsigned int n = index_count, i = 0;
+  unsigned int best = n, best_size = __UINT32_MAX__;
+
+#ifdef __AVX2__
+  __m256i below = _mm256_set1_epi32(asize - 1);
+  __m256i need = _mm256_set1_epi32(asize);
+  if (n >= 8) {
+    __m256i none = _mm256_set1_epi32(__INT32_MAX__);
+    __m256i vmin = none, vpos = _mm256_setzero_si256();
+    __m256i pos = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i step = _mm256_set1_epi32(8);
+    unsigned int lane_min[8], lane_pos[8];
+    for (; i + 8 <= n; i += 8) {
+      __m256i v = _mm256_loadu_si256((__m256i *)(index_sizes + i));
+      int exact = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(v, need)));
+      if (exact)
+        return (char *) index_blocks[i + __builtin_ctz(exact)];
+      // Sizes that don't fit never win the minimum
+      v = _mm256_blendv_epi8(none, v, _mm256_cmpgt_epi32(v, below));
+      __m256i smaller = _mm256_cmpgt_epi32(vmin, v);
+      vmin = _mm256_min_epi32(vmin, v);
+      vpos = _mm256_blendv_epi8(vpos, pos, smaller);
+      pos = _mm256_add_epi32(pos, step);
+    }
+    _mm256_storeu_si256((__m256i *)lane_min, vmin);
+    _mm256_storeu_si256((__m256i *)lane_pos, vpos);
+    for (int lane = 0; lane < 8; lane++)
+      if (lane_min[lane] < best_size && lane_min[lane] != __INT32_MAX__) {
+        best_size = lane_min[lane];
+        best = lane_pos[lane];
+      }
+  }
+#endif
+  for (; i < n; i++) {
+    unsigned int size = index_sizes[i];
+    if (size < asize)
+      continue;
+    if (size == asize)
+      return (char *) index_blocks[i];
+    if (size < best_size) {
+      best_size = size;
+      best = i;
+    }
+  }
+  return best < n ? (char *) index_blocks[best] : NULL;
+}
+#endif
+
+/*
+ * place - Allocate asize bytes of free block bp and return the allocated
+ *     block, from the low end of the free block. With MM_PLACE_HIGH, big
+ *     blocks come from the high end instead, so that long-lived small
+ *     blocks don't end up between big ones and pin their space when those
+ *     are freed. Either way the free remainder stays a single block that
+ *     coalesce can merge.
+ */
+static void *place(void *bp, size_t asize)
 {
+  PROF_SCOPE(PROF_PLACE);
   char *hdrp = HDRP(bp);
+#ifdef MM_SCAVENGE
+  /* Page aligned interior, zero if the block was purged */
+  unsigned int purged = GET_PURGED(hdrp);
+  size_t pagesize = mem_pagesize();
+  char *interior_lo = (char *)(((unsigned long)bp + LINKS_SIZE + (pagesize-1)) & ~(pagesize-1));
+  char *interior_hi = (char *)((unsigned long)FTRP(bp) & ~(pagesize-1));
+#else
+  unsigned int purged = 0;
+#endif
   unsigned int pred = GET_WORD(PRED(bp));
   unsigned int succ = GET_WORD(SUCC(bp));
   
   size_t size = GET_SIZE(hdrp);
   size_t diff = size - asize;
   
-  if (diff >= (2 * DSIZE)) {
+  if (diff >= MIN_BLOCK && PLACE_HIGH(asize)) {
+    // Split, allocating the high end
+    // The free part keeps its place in the list and the remainder's
+    // interior is part of the original one
+    PUT_WORD(hdrp, PACK(diff, 0, 1) | purged);
+    PUT_WORD(FTRP(bp), PACK(diff, 0, 1));
+    index_update(bp);
+    bp = NEXT_BLKP(bp);
+    PUT_WORD(HDRP(bp), PACK(asize, 1, 0));
+    // Update the next block (allocated neighbor)
+    char *next = NEXT_BLKP(bp);
+    PUT_WORD(HDRP(next), PACK(GET_SIZE(HDRP(next)), 1, 1));
+  } else if (diff >= MIN_BLOCK) {
     // Split
     // Allocate header
     PUT_WORD(hdrp, PACK(asize, 1, 1));
     // Write free block's metadata
     char *next = NEXT_BLKP(bp);
-    PUT_WORD(HDRP(next), PACK(diff, 0, 1));
+    /* The remainder's interior is part of the original one */
+    PUT_WORD(HDRP(next), PACK(diff, 0, 1) | purged);
     PUT_WORD(FTRP(next), PACK(diff, 0, 1));
     PUT_WORD(SUCC(next), succ);
     PUT_WORD(PRED(next), pred);
+#ifdef MM_SIDE_INDEX
+    PUT_WORD(INDEXP(next), GET_WORD(INDEXP(bp)));
+#endif
+    index_update(next);
+    SCAVENGE_UNLINK(bp, next);
     // Connect the free list back in place, not LIFO
     if (pred != (unsigned int) NULL) PUT_WORD(SUCC(pred), (unsigned int) next);
     else free_list = next;
@@ -196,11 +732,25 @@ static void place(void *bp, size_t asize)
     // Update the next block (allocated neighbor)
     char *next = NEXT_BLKP(bp);
     PUT_WORD(HDRP(next), PACK(GET_SIZE(HDRP(next)), 1, 1));
+    index_del(bp);
+    SCAVENGE_UNLINK(bp, (char *) succ);
     // Connect the free list
     if (pred != (unsigned int) NULL) PUT_WORD(SUCC(pred), (unsigned int) succ);
     else free_list = (char *) succ;
     if (succ != (unsigned int) NULL) PUT_WORD(PRED(succ), (unsigned int) pred);
   }
+
+  free_bytes -= GET_SIZE(HDRP(bp));
+
+#ifdef MM_SCAVENGE
+  /* Tell mm_calloc which part of the payload is still zero from a purge */
+  zero_lo = zero_hi = NULL;
+  if (purged) {
+    zero_lo = MAX(interior_lo, (char *)bp);
+    zero_hi = MIN(interior_hi, (char *)bp + GET_SIZE(HDRP(bp)) - WSIZE);
+  }
+#endif
+  return bp;
 }
 
 /*
@@ -208,23 +758,77 @@ static void place(void *bp, size_t asize)
  */
 void mm_free(void *ptr)
 {
+  PROF_SCOPE(PROF_FREE);
+  HEAPMAP_TICK();
+  CHECK_STEP();
+  PERSIST_DIRTY();
+  SAMPLE_FREE(ptr);
+#ifdef MM_MMAP
+  if (GET_MMAPPED(HDRP(ptr))) {
+    munmap((char *)ptr - DSIZE, GET_SIZE(HDRP(ptr)));
+    return;
+  }
+#endif
   char *hdrp = HDRP(ptr);
   size_t size = GET_SIZE(hdrp);
   int prev_alloc = GET_PREV_ALLOC(hdrp);
 
   PUT_WORD(HDRP(ptr), PACK(size, 0, prev_alloc));
   PUT_WORD(FTRP(ptr), PACK(size, 0, prev_alloc));
+  free_bytes += size;
   char *new_ptr = (char *) coalesce(ptr);
 
   // Connect to list using LIFO
-  if (free_list != NULL) PUT_WORD(PRED(free_list), (unsigned int) new_ptr);
-  PUT_WORD(SUCC(new_ptr), (unsigned int) free_list);
-  PUT_WORD(PRED(new_ptr), (unsigned int) NULL);
-  free_list = new_ptr;
+  push(new_ptr);
+
+#ifdef MM_SCAVENGE
+  if ((freed_since_scavenge += size) >= SCAVENGE_INTERVAL) {
+    scavenge();
+    freed_since_scavenge = 0;
+  }
+#endif
+}
+
+#ifdef MM_SCAVENGE
+/*
+ * scavenge - Return the pages inside big free blocks to the OS. Walks the
+ *     free list from where the last pass stopped, wrapping around to the
+ *     head, where recently freed blocks are, until it has purged
+ *     SCAVENGE_BUDGET blocks or gone once around. Headers, footers and
+ *     the pred and succ fields are kept. On the private anonymous heap, MADV_DONTNEED,
+ *     unlike MADV_FREE, makes the pages read back as zero, which mm_calloc
+ *     relies on. A shared file mapping would read back the file instead,
+ *     which is why MM_PERSIST excludes MM_SCAVENGE.
+ */
+static void scavenge(void)
+{
+  size_t pagesize = mem_pagesize();
+  int budget = SCAVENGE_BUDGET;
+  char *start = scavenge_cursor ? scavenge_cursor : free_list;
+  char *bp = start;
+
+  if (bp == NULL)
+    return;
+  do {
+    char *hdrp = HDRP(bp);
+    if (GET_SIZE(hdrp) >= SCAVENGE_MIN && !GET_PURGED(hdrp)) {
+      char *lo = (char *)(((unsigned long)bp + LINKS_SIZE + (pagesize-1)) & ~(pagesize-1));
+      char *hi = (char *)((unsigned long)FTRP(bp) & ~(pagesize-1));
+      if (lo < hi && madvise(lo, hi - lo, MADV_DONTNEED) == 0) {
+        PUT_WORD(hdrp, GET_WORD(hdrp) | PURGED);
+        budget--;
+      }
+    }
+    if ((bp = (char *) GET_WORD(SUCC(bp))) == NULL)
+      bp = free_list;
+  } while (bp != start && budget > 0);
+  scavenge_cursor = bp;
 }
+#endif
 
 static void *coalesce(void *bp)
 {
+  PROF_SCOPE(PROF_COALESCE);
   char *hdrp = HDRP(bp);
   char *prev = PREV_BLKP(bp);
   char *next = NEXT_BLKP(bp);
@@ -244,9 +848,12 @@ static void *coalesce(void *bp)
 
     char *new_next = NEXT_BLKP(bp);
     PUT_WORD(HDRP(new_next), PACK(GET_SIZE(HDRP(new_next)), 1, 0));
+    CHECK_ABSORB(next, bp);
 
+    index_del(next);
     unsigned int pred = GET_WORD(PRED(next));
     unsigned int succ = GET_WORD(SUCC(next));
+    SCAVENGE_UNLINK(next, (char *) succ);
     if (pred != (unsigned int) NULL) PUT_WORD(SUCC(pred), (unsigned int) succ);
     else free_list = (char *) succ;
     if (succ != (unsigned int) NULL) PUT_WORD(PRED(succ), (unsigned int) pred);
@@ -256,12 +863,15 @@ static void *coalesce(void *bp)
     size += GET_SIZE(HDRP(PREV_BLKP(bp)));
     PUT_WORD(FTRP(bp), PACK(size, 0, 1));
     PUT_WORD(HDRP(PREV_BLKP(bp)), PACK(size, 0, 1));
+    CHECK_ABSORB(bp, prev);
     bp = PREV_BLKP(bp);
 
     PUT_WORD(HDRP(next), PACK(GET_SIZE(HDRP(next)), next_alloc, 0));
 
+    index_del(prev);
     unsigned int pred = GET_WORD(PRED(prev));
     unsigned int succ = GET_WORD(SUCC(prev));
+    SCAVENGE_UNLINK(prev, (char *) succ);
     if (pred != (unsigned int) NULL) PUT_WORD(SUCC(pred), (unsigned int) succ);
     else free_list = (char *) succ;
     if (succ != (unsigned int) NULL) PUT_WORD(PRED(succ), (unsigned int) pred);
@@ -271,19 +881,25 @@ static void *coalesce(void *bp)
     size += GET_SIZE(HDRP(PREV_BLKP(bp))) + GET_SIZE(FTRP(NEXT_BLKP(bp)));
     PUT_WORD(HDRP(PREV_BLKP(bp)), PACK(size, 0, 1));
     PUT_WORD(FTRP(NEXT_BLKP(bp)), PACK(size, 0, 1));
+    CHECK_ABSORB(bp, prev);
+    CHECK_ABSORB(next, prev);
     bp = PREV_BLKP(bp);
 
     char *new_next = NEXT_BLKP(bp);
     PUT_WORD(HDRP(new_next), PACK(GET_SIZE(HDRP(new_next)), 1, 0));
     
+    index_del(next);
+    index_del(prev);
     unsigned int pred_next = GET_WORD(PRED(next));
     unsigned int succ_next = GET_WORD(SUCC(next));
+    SCAVENGE_UNLINK(next, (char *) succ_next);
     if (pred_next != (unsigned int) NULL) PUT_WORD(SUCC(pred_next), (unsigned int) succ_next);
     else free_list = (char *) succ_next;
     if (succ_next != (unsigned int) NULL) PUT_WORD(PRED(succ_next), (unsigned int) pred_next);
 
     unsigned int pred_prev = GET_WORD(PRED(prev));
     unsigned int succ_prev = GET_WORD(SUCC(prev));
+    SCAVENGE_UNLINK(prev, (char *) succ_prev);
     if (pred_prev != (unsigned int) NULL) PUT_WORD(SUCC(pred_prev), (unsigned int) succ_prev);
     else free_list = (char *) succ_prev;
     if (succ_prev != (unsigned int) NULL) PUT_WORD(PRED(succ_prev), (unsigned int) pred_prev);
@@ -291,23 +907,630 @@ static void *coalesce(void *bp)
   return bp;
 }
 
-// TODO
+/* push - Put free block bp at the head of the free list (LIFO) */
+static void push(char *bp)
+{
+  if (free_list != NULL) PUT_WORD(PRED(free_list), (unsigned int) bp);
+  PUT_WORD(SUCC(bp), (unsigned int) free_list);
+  PUT_WORD(PRED(bp), (unsigned int) NULL);
+  free_list = bp;
+  index_add(bp);
+}
+
+#ifdef MM_MMAP
+/*
+ * mmap_block - Map a huge block on its own. The mapping starts with a pad
+ *     word and the block header, so the payload stays double word aligned.
+ *     The header records the length of the whole mapping.
+ */
+static void *mmap_block(size_t size)
+{
+  size_t pagesize = mem_pagesize();
+  size_t len = (size + DSIZE + (pagesize-1)) & ~(pagesize-1);
+  char *p;
+
+  if ((p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED)
+    return NULL;
+  PUT_WORD(p + WSIZE, PACK(len, 1, 0) | MMAPPED);
+  return p + DSIZE;
+}
+
 /*
- * mm_realloc - Implemented simply in terms of mm_malloc and mm_free
+ * mremap_block - Resize a mapped block by moving its page tables,
+ *     so growing it costs O(pages) instead of a memcpy of the payload.
+ */
+static void *mremap_block(void *bp, size_t size)
+{
+  size_t pagesize = mem_pagesize();
+  size_t oldlen = GET_SIZE(HDRP(bp));
+  size_t len = (size + DSIZE + (pagesize-1)) & ~(pagesize-1);
+  char *p;
+
+  if (len == oldlen)
+    return bp;
+  if ((p = mremap((char *)bp - DSIZE, oldlen, len, MREMAP_MAYMOVE)) == MAP_FAILED)
+    return NULL;
+  PUT_WORD(p + WSIZE, PACK(len, 1, 0) | MMAPPED);
+  return p + DSIZE;
+}
+#endif
+
+/*
+ * mm_calloc - Allocate zeroed memory, skipping pages that are already zero.
+ */
+void *mm_calloc(size_t nmemb, size_t size)
+{
+  size_t bytes = nmemb * size;
+  char *bp;
+
+  if (nmemb != 0 && bytes / nmemb != size)
+    return NULL;
+  if ((bp = mm_malloc(bytes)) == NULL)
+    return NULL;
+#ifdef MM_MMAP
+  /* Fresh mappings are zero-filled */
+  if (GET_MMAPPED(HDRP(bp)))
+    return bp;
+#endif
+#ifdef MM_SCAVENGE
+  if (zero_lo < zero_hi && zero_lo < bp + bytes) {
+    memset(bp, 0, zero_lo - bp);
+    if (zero_hi < bp + bytes)
+      memset(zero_hi, 0, bp + bytes - zero_hi);
+    return bp;
+  }
+#endif
+  memset(bp, 0, bytes);
+  return bp;
+}
+
+/*
+ * mm_heapsize - Bytes from the start of the heap to the break, like
+ *     mem_heapsize, but also for heaps that aren't memlib's.
+ */
+size_t mm_heapsize(void)
+{
+  return heap_brk - (heap_listp - DSIZE);
+}
+
+/*
+ * mm_heap_snapshot - Write the offset, size and allocated bit of every
+ *     block, walking from the prologue to the epilogue, to a heap map file.
+ */
+int mm_heap_snapshot(const char *path)
+{
+  char *heap_lo = heap_listp - DSIZE;
+  unsigned int nblocks = 0;
+  char *bp;
+  FILE *f;
+
+  if ((f = heapmap_open(path, "best-fit", mem_pagesize())) == NULL)
+    return -1;
+  for (bp = NEXT_BLKP(heap_listp); GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp), nblocks++)
+    heapmap_block(f, HDRP(bp) - heap_lo, GET_SIZE(HDRP(bp)), GET_ALLOC(HDRP(bp)));
+  return heapmap_close(f, bp - heap_lo, nblocks);
+}
+
+#ifdef MM_CHECK
+/*
+ * check_step - Every MM_CHECK_PERIOD calls, check the next MM_CHECK
+ *     blocks, picking up where the last check stopped and wrapping around
+ *     at the epilogue, so that the whole heap is covered every so many
+ *     calls at a bounded cost per call. A block's allocated bit must match
+ *     the prev_alloc bit of the block after it. A free block must match its
+ *     footer, have allocated neighbors, and be linked back to by its pred
+ *     and succ.
+ */
+static void check_step(void)
+{
+  char *bp = check_cursor ? check_cursor : heap_listp;
+  char *start = bp;
+
+  if (++check_calls % (MM_CHECK_PERIOD) != 0)
+    return;
+
+  /* At most one lap, however big the budget */
+  for (int budget = MM_CHECK; budget > 0; budget--) {
+    char *hdrp = HDRP(bp);
+    size_t size = GET_SIZE(hdrp);
+    char *next = bp + size;
+
+    if (size == 0) {
+      if (hdrp != heap_brk - WSIZE || !GET_ALLOC(hdrp))
+        check_fail(bp, "epilogue isn't at the break");
+      bp = heap_listp;
+      if (bp == start)
+        break;
+      continue;
+    }
+    if (size % DSIZE != 0 || HDRP(next) > heap_brk - WSIZE)
+      check_fail(bp, "size runs past the break");
+    if (GET_PREV_ALLOC(HDRP(next)) != GET_ALLOC(hdrp))
+      check_fail(bp, "next block's prev_alloc bit is wrong");
+    if (!GET_ALLOC(hdrp)) {
+      char *pred = (char *) GET_WORD(PRED(bp));
+      char *succ = (char *) GET_WORD(SUCC(bp));
+      if (size < MIN_BLOCK || GET_SIZE(FTRP(bp)) != size || GET_ALLOC(FTRP(bp)))
+        check_fail(bp, "header and footer disagree");
+      if (!GET_ALLOC(HDRP(next)))
+        check_fail(bp, "free neighbors weren't coalesced");
+      if (pred != NULL && (pred <= heap_listp || pred >= heap_brk || GET_ALLOC(HDRP(pred))
+                           || (char *) GET_WORD(SUCC(pred)) != bp))
+        check_fail(bp, "pred doesn't link back");
+      if (pred == NULL && free_list != bp)
+        check_fail(bp, "no pred, but not the head of the free list");
+      if (succ != NULL && (succ <= heap_listp || succ >= heap_brk || GET_ALLOC(HDRP(succ))
+                           || (char *) GET_WORD(PRED(succ)) != bp))
+        check_fail(bp, "succ doesn't link back");
+#ifdef MM_SIDE_INDEX
+      unsigned int i = GET_WORD(INDEXP(bp));
+      if (i != INDEX_CAP && (i >= index_count || index_blocks[i] != (unsigned int) bp
+                             || index_sizes[i] != size))
+        check_fail(bp, "side index entry is stale");
+#endif
+    }
+    if ((bp = next) == start)
+      break;
+  }
+  check_cursor = bp;
+}
+
+/* check_fail - Report a corrupt block, by its offset as in heap maps */
+static void check_fail(char *bp, const char *what)
+{
+  fprintf(stderr, "mm_check: block at offset %ld, header %#x: %s\n",
+          (long)(HDRP(bp) - (heap_listp - DSIZE)), GET_WORD(HDRP(bp)), what);
+  abort();
+}
+#endif
+
+/*
+ * mm_halloc - Allocate a block that mm_compact may move, and return a
+ *     handle to it, or 0 if out of memory.
+ */
+mm_handle_t mm_halloc(size_t size)
+{
+  unsigned int slot;
+  char *bp;
+
+  if (handles_free == 0) {
+    /* Grow the table, threading the new slots onto the unused list */
+    unsigned int cap = handles_cap ? 2*handles_cap : 64;
+    struct handle *table = mm_realloc(handles, cap * sizeof(*table));
+    if (table == NULL)
+      return 0;
+    for (slot = handles_cap; slot < cap; slot++) {
+      table[slot].bp = NULL;
+      table[slot].pins = slot + 1 < cap ? slot + 2 : 0;
+    }
+    handles = table;
+    handles_free = handles_cap + 1;
+    handles_cap = cap;
+  }
+  if ((bp = mm_malloc(size + DSIZE)) == NULL)
+    return 0;
+  slot = handles_free - 1;
+  handles_free = handles[slot].pins;
+  handles[slot].bp = bp;
+  handles[slot].pins = 0;
+  PUT_WORD(bp, slot);
+  return slot + 1;
+}
+
+/*
+ * mm_hlock - Pin a handle's block and return its payload, which stays put
+ *     until the matching mm_hunlock.
+ */
+void *mm_hlock(mm_handle_t h)
+{
+  handles[h-1].pins++;
+  return handles[h-1].bp + DSIZE;
+}
+
+void mm_hunlock(mm_handle_t h)
+{
+  handles[h-1].pins--;
+}
+
+void mm_hfree(mm_handle_t h)
+{
+  mm_free(handles[h-1].bp);
+  handles[h-1].bp = NULL;
+  handles[h-1].pins = handles_free;
+  handles_free = h;
+}
+
+/*
+ * mm_compact - Slide unlocked handle blocks toward the start of the heap.
+ *     Free blocks are gathered in one pass: a gap grows while free blocks
+ *     are crossed and movable blocks are moved down across it. It is closed
+ *     into a single free block before a block that can't move, and at the
+ *     epilogue. The free list is rebuilt from the closed gaps. Returns the
+ *     size of the free block at the top of the heap.
+ */
+size_t mm_compact(void)
+{
+  char *bp = NEXT_BLKP(heap_listp);
+  char *gap = NULL;
+  size_t gap_size = 0;
+
+  PERSIST_DIRTY();
+  CHECK_RESTART();
+  SCAVENGE_RESTART();
+  free_list = NULL;
+  index_reset();
+  while (GET_SIZE(HDRP(bp)) > 0) {
+    size_t size = GET_SIZE(HDRP(bp));
+    char *next = NEXT_BLKP(bp);
+    unsigned int slot = GET_WORD(bp);
+
+    if (!GET_ALLOC(HDRP(bp))) {
+      if (gap == NULL)
+        gap = bp;
+      gap_size += size;
+    } else if (gap != NULL && size >= 2*DSIZE && slot < handles_cap
+               && handles[slot].bp == bp && handles[slot].pins == 0) {
+      memmove(HDRP(gap), HDRP(bp), size);
+      SAMPLE_MOVE(bp, gap);
+      PUT_WORD(HDRP(gap), PACK(size, 1, 1));
+      handles[slot].bp = gap;
+      gap += size;
+    } else if (gap != NULL) {
+      close_gap(gap, gap_size);
+      PUT_WORD(HDRP(bp), PACK(size, 1, 0));
+      gap = NULL;
+      gap_size = 0;
+    }
+    bp = next;
+  }
+
+  if (gap == NULL)
+    return 0;
+  close_gap(gap, gap_size);
+  PUT_WORD(HDRP(bp), PACK(0, 1, 0)); /* Epilogue header */
+#ifdef MM_SCAVENGE
+  /* The top block is now at the head of the free list */
+  scavenge();
+#endif
+  return gap_size;
+}
+
+/* close_gap - Turn a compaction gap into a free block on the free list */
+static void close_gap(char *bp, size_t size)
+{
+  PUT_WORD(HDRP(bp), PACK(size, 0, 1));
+  PUT_WORD(FTRP(bp), PACK(size, 0, 1));
+  push(bp);
+}
+
+#ifdef MM_PERSIST
+/*
+ * mm_open - Map the heap file at path, creating it if needed. A heap that
+ *     was checkpointed with mm_sync is reattached as it was, in O(1): the
+ *     mapping is always at PERSIST_BASE, so every pointer in it is still
+ *     valid. A new file, or one changed after its last checkpoint, gets a
+ *     fresh heap. Returns 1 if reattached, 0 if fresh, -1 on error.
+ */
+int mm_open(const char *path)
+{
+  struct stat st;
+  char *p;
+  int fd;
+
+  if ((fd = open(path, O_RDWR | O_CREAT, 0600)) == -1)
+    return -1;
+  if (fstat(fd, &st) == -1
+      || (st.st_size < PERSIST_SIZE && ftruncate(fd, PERSIST_SIZE) == -1)) {
+    close(fd);
+    return -1;
+  }
+  p = mmap((void *)PERSIST_BASE, PERSIST_SIZE, PROT_READ | PROT_WRITE,
+           MAP_SHARED | MAP_FIXED_NOREPLACE, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED)
+    return -1;
+  if (p != (char *)PERSIST_BASE) {
+    /* Kernels without MAP_FIXED_NOREPLACE take the address as a hint */
+    munmap(p, PERSIST_SIZE);
+    return -1;
+  }
+  persist = (struct persist_header *)p;
+
+  if (persist->magic != PERSIST_MAGIC || !persist->clean) {
+    persist->magic = 0;
+    if (mm_init() == -1)
+      return -1;
+    return mm_sync() == -1 ? -1 : 0;
+  }
+
+  heap_listp = persist->heap_listp;
+  free_list = persist->free_list;
+  heap_brk = persist->heap_brk;
+  chunksize = persist->chunksize;
+  free_bytes = persist->free_bytes;
+  mallocs_since_extend = 0;
+  handles = persist->handles;
+  handles_cap = persist->handles_cap;
+  handles_free = persist->handles_free;
+  CHECK_RESTART();
+  /* Locks don't outlive the process that took them */
+  for (unsigned int slot = 0; slot < handles_cap; slot++)
+    if (handles[slot].bp != NULL)
+      handles[slot].pins = 0;
+  return 1;
+}
+
+/*
+ * mm_sync - Checkpoint: save the allocator's state to the header page and
+ *     flush the heap to the file. The header is marked clean last, so a
+ *     crash during the flush leaves it dirty and mm_open starts over.
+ */
+int mm_sync(void)
+{
+  persist->clean = 0;
+  persist->heap_listp = heap_listp;
+  persist->free_list = free_list;
+  persist->heap_brk = heap_brk;
+  persist->chunksize = chunksize;
+  persist->free_bytes = free_bytes;
+  persist->handles = handles;
+  persist->handles_cap = handles_cap;
+  persist->handles_free = handles_free;
+  persist->magic = PERSIST_MAGIC;
+  if (msync(persist, heap_brk - (char *)persist, MS_SYNC) == -1)
+    return -1;
+  persist->clean = 1;
+  return msync(persist, mem_pagesize(), MS_SYNC);
+}
+
+/*
+ * mm_set_root, mm_get_root - The one pointer the application needs to find
+ *     its data in a reattached heap.
+ */
+void mm_set_root(void *root)
+{
+  PERSIST_DIRTY();
+  persist->root = root;
+}
+
+void *mm_get_root(void)
+{
+  return persist->root;
+}
+
+/*
+ * persist_dirty - Mark the checkpoint stale before the first change after
+ *     it, so that mm_open won't trust a heap that crashed mid-change.
+ */
+static void persist_dirty(void)
+{
+  persist->clean = 0;
+  msync(persist, mem_pagesize(), MS_SYNC);
+}
+#endif
+
+#ifdef MM_PROFILE
+/*
+ * mm_prof_dump - Write this thread's hot path histograms as CSV.
+ */
+void mm_prof_dump(FILE *out)
+{
+  prof_dump(out);
+}
+#endif
+
+#ifdef MM_SAMPLE
+/*
+ * mm_sample_dump - Write the sampled call sites as CSV, with their
+ *     estimated live bytes and allocation rate.
+ */
+void mm_sample_dump(FILE *out)
+{
+  sample_dump(out);
+}
+#endif
+
+/*
+ * mm_realloc - Move the block to one of size bytes. Mapped blocks that stay
+ *     huge are remapped. With MM_REALLOC_INPLACE, resize in place when the
+ *     block can shrink, or grow at the top of the heap (see resize), and a
+ *     block that keeps growing, GROW_STREAK reallocs in a row, gets half its
+ *     size again as slack.
  */
 void *mm_realloc(void *ptr, size_t size)
 {
-  void *oldptr = ptr;
+  if (ptr == NULL)
+    return mm_malloc(size);
+  if (size == 0) {
+    mm_free(ptr);
+    return NULL;
+  }
+
+#ifdef MM_REALLOC_INPLACE
+  /* Count how many times in a row the last block realloc returned grew */
+  size_t cap = size;
+  grow_streak = ptr == grow_bp && size > grow_size ? grow_streak + 1 : 0;
+  grow_size = size;
+  if (grow_streak >= GROW_STREAK) {
+    /* Growth within the slack is free; past it, get half as much again */
+    if (size + DSIZE <= GET_SIZE(HDRP(ptr)))
+      return ptr;
+    cap = size + size/2;
+  }
+  grow_bp = mm_realloc_hint(ptr, size, cap);
+  return grow_bp;
+#else
+#ifdef MM_MMAP
+  if (GET_MMAPPED(HDRP(ptr)))
+    return realloc_mapped(ptr, size, size);
+#endif
+  return move_block(ptr, mm_malloc(size), size);
+#endif
+}
+
+/*
+ * mm_realloc_hint - Resize ptr to size bytes, for a block expected to grow
+ *     up to expected_max. The block is made that big whenever it grows or
+ *     moves, and a block that has to move is placed at the top of the heap,
+ *     so growth up to expected_max stays in place and the heap can be
+ *     extended beneath it after that.
+ */
+void *mm_realloc_hint(void *ptr, size_t size, size_t expected_max)
+{
   void *newptr;
+  size_t cap = MAX(size, expected_max);
+
+  if (ptr == NULL)
+    return mm_malloc(cap);
+  if (size == 0) {
+    mm_free(ptr);
+    return NULL;
+  }
+
+#ifdef MM_MMAP
+  if (GET_MMAPPED(HDRP(ptr)))
+    return realloc_mapped(ptr, size, cap);
+#endif
+  if (resize(ptr, adjust_size(size), adjust_size(cap)) != NULL)
+    return ptr;
+#ifdef MM_MMAP
+  /* A block that outgrows the heap moves to a mapping of its own */
+  if (cap >= MMAP_THRESHOLD)
+    return move_block(ptr, mm_malloc(cap), size);
+#endif
+
+  if (cap > size) {
+    newptr = place_top(adjust_size(cap));
+    SAMPLE_ALLOC(newptr, cap);
+  } else {
+    newptr = mm_malloc(size);
+  }
+  return move_block(ptr, newptr, size);
+}
+
+/*
+ * move_block - Copy up to size bytes of payload from oldptr to newptr and
+ *     free oldptr. Returns newptr, or NULL, leaving oldptr alone, if the
+ *     new block couldn't be allocated.
+ */
+static void *move_block(void *oldptr, void *newptr, size_t size)
+{
   size_t copySize;
-  
-  newptr = mm_malloc(size);
+
   if (newptr == NULL)
     return NULL;
-  copySize = GET_SIZE(HDRP(oldptr));
+  /* Payload is the block minus its header (and pad word, if mapped) */
+  copySize = GET_SIZE(HDRP(oldptr)) - WSIZE;
+#ifdef MM_MMAP
+  if (GET_MMAPPED(HDRP(oldptr)))
+    copySize -= WSIZE;
+#endif
   if (size < copySize)
     copySize = size;
   memcpy(newptr, oldptr, copySize);
   mm_free(oldptr);
   return newptr;
 }
+
+#ifdef MM_MMAP
+/*
+ * realloc_mapped - Resize a mapped block: remap it while it stays huge,
+ *     otherwise move it to a block of cap bytes.
+ */
+static void *realloc_mapped(void *ptr, size_t size, size_t cap)
+{
+  void *newptr;
+
+  if (size < MMAP_THRESHOLD)
+    return move_block(ptr, mm_malloc(cap), size);
+  if ((newptr = mremap_block(ptr, cap)) != NULL)
+    SAMPLE_MOVE(ptr, newptr);
+  return newptr;
+}
+#endif
+
+/*
+ * resize - Make block bp acap bytes in place, or at least asize if that's
+ *     all the room there is. A block at the top of the heap grows into the
+ *     free block after it and then the heap; elsewhere, growing into a free
+ *     neighbor would cut it where best fit wouldn't, so the block moves.
+ *     A tail of at least MIN_BLOCK bytes is freed through mm_free, which
+ *     coalesces it. Returns NULL if the block should move instead, also
+ *     when it shrinks below half, so it can go to a better fit.
+ */
+static void *resize(void *bp, size_t asize, size_t acap)
+{
+  char *next = NEXT_BLKP(bp);
+  size_t size = GET_SIZE(HDRP(bp));
+  size_t avail = size;
+  int at_top;
+
+  if (acap < size/2)
+    return NULL;
+  if (!GET_ALLOC(HDRP(next))) {
+    avail += GET_SIZE(HDRP(next));
+    at_top = GET_SIZE(HDRP(NEXT_BLKP(next))) == 0;
+  } else {
+    at_top = GET_SIZE(HDRP(next)) == 0;
+  }
+  if (asize > size && !at_top)
+    return NULL;
+
+  PERSIST_DIRTY();
+
+  /* The new space is merged with any free block there, and is listed */
+  if (avail < acap && at_top
+      && (next = extend_heap(MAX(acap - avail, MIN_BLOCK)/WSIZE)) != NULL) {
+    push(next);
+    avail = size + GET_SIZE(HDRP(next));
+  }
+  if (avail < asize)
+    return NULL;
+
+  if (avail > size) {
+    /* Take the whole next block */
+    unsigned int pred = GET_WORD(PRED(next));
+    unsigned int succ = GET_WORD(SUCC(next));
+    index_del(next);
+    SCAVENGE_UNLINK(next, (char *) succ);
+    if (pred != (unsigned int) NULL) PUT_WORD(SUCC(pred), (unsigned int) succ);
+    else free_list = (char *) succ;
+    if (succ != (unsigned int) NULL) PUT_WORD(PRED(succ), (unsigned int) pred);
+    free_bytes -= avail - size;
+    CHECK_ABSORB(next, (char *)bp);
+    PUT_WORD(HDRP(bp), PACK(avail, 1, GET_PREV_ALLOC(HDRP(bp))));
+    next = NEXT_BLKP(bp);
+    PUT_WORD(HDRP(next), GET_WORD(HDRP(next)) | 0x2);
+  }
+
+  /* Free what's left past acap */
+  acap = MIN(acap, avail);
+  if (avail - acap >= MIN_BLOCK) {
+    PUT_WORD(HDRP(bp), PACK(acap, 1, GET_PREV_ALLOC(HDRP(bp))));
+    next = NEXT_BLKP(bp);
+    PUT_WORD(HDRP(next), PACK(avail - acap, 1, 1));
+    mm_free(next);
+  }
+  return bp;
+}
+
+/*
+ * place_top - Allocate a block at the top of the heap, growing the free
+ *     block there, or the heap, until it fits. Nothing but free space is
+ *     left above it, so it can keep growing in place.
+ */
+static void *place_top(size_t asize)
+{
+  char *epilogue = heap_brk - WSIZE;
+  size_t top = GET_PREV_ALLOC(epilogue) ? 0 : GET_SIZE(epilogue - WSIZE);
+  char *bp = heap_brk - top;
+
+  PERSIST_DIRTY();
+  if (top < asize) {
+    if ((bp = extend_heap((asize - top)/WSIZE)) == NULL)
+      return NULL;
+    push(bp);
+  }
+  return place(bp, asize);
+}
@@ -0,0 +1,244 @@
+/*
+ * mm-bitmap.c - Metadata out of band, so payload cache lines stay clean.
+ *
+ * Blocks have no headers or footers; the heap is split in 8 byte granules;
+ * an alloc bitmap has a bit set for every granule of an allocated block;
+ * a start bitmap has a bit set for the first granule of each one;
+ * both bitmaps live in a mapping of their own, away from the payloads;
+ * a block ends at the next start bit or clear alloc bit, found with ctz;
+ * free space is just clear alloc bits, so freeing coalesces by itself;
+ * Next-fit policy, scanning the alloc bitmap 64 granules at a time;
+ * Realloc shrinks, and grows into free granules that follow, in place.
+ */
+#define _GNU_SOURCE
+#include <sys/mman.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+#include <string.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+team_t team = {"ateam", "Lucas", "fake@email.com", "", ""};
+
+#define GSIZE 8 /* Granule size, and alignment (bytes) */
+#define CHUNKSIZE (1<<12) /* Extend heap by at least this amount (bytes) */
+#define BITMAP_HEAP (1UL<<30) /* Largest heap the bitmaps cover (bytes) */
+#define MAP_WORDS (BITMAP_HEAP / GSIZE / 64) /* 64 bit words per bitmap */
+#define NO_FIT ((size_t)-1)
+#define MAX(x, y) ((x) > (y)? (x) : (y))
+#define MIN(x, y) ((x) < (y)? (x) : (y))
+/* Granules needed for size bytes */
+#define GRANULES(size) (((size) + (GSIZE-1)) / GSIZE)
+/* Convert between a payload address and its granule number */
+#define GRANULE(ptr) ((size_t)((char *)(ptr) - heap_lo) / GSIZE)
+#define ADDRESS(g) (heap_lo + (g) * GSIZE)
+/* Read, set and clear the bit of granule g */
+#define GET_BIT(map, g) (((map)[(g) / 64] >> ((g) % 64)) & 1)
+#define SET_BIT(map, g) ((map)[(g) / 64] |= 1UL << ((g) % 64))
+#define CLEAR_BIT(map, g) ((map)[(g) / 64] &= ~(1UL << ((g) % 64)))
+
+static size_t next_bit(unsigned long *map, unsigned long flip, size_t g);
+static size_t block_end(size_t g);
+static void set_range(unsigned long *map, size_t lo, size_t hi, int set);
+static size_t find_fit(size_t n, size_t from, size_t to, size_t *top);
+static int extend_heap(size_t n);
+static unsigned long *alloc_map; // Granules that belong to allocated blocks.
+static unsigned long *start_map; // First granule of each allocated block.
+static char *heap_lo; // Granule 0.
+static size_t heap_granules; // Granules from heap_lo to the break.
+static size_t rover; // Where the next search starts.
+
+/*
+ * mm_init - initialize the malloc package.
+ */
+int mm_init(void)
+{
+    /* The bitmaps are reserved once; later runs clear what was used */
+    if (alloc_map == NULL) {
+      char *p = mmap(NULL, 2 * MAP_WORDS * sizeof(unsigned long), PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+      if (p == MAP_FAILED)
+        return -1;
+      alloc_map = (unsigned long *)p;
+      start_map = alloc_map + MAP_WORDS;
+    } else {
+      memset(alloc_map, 0, (heap_granules + 63) / 64 * sizeof(unsigned long));
+      memset(start_map, 0, (heap_granules + 63) / 64 * sizeof(unsigned long));
+    }
+    if ((heap_lo = mem_sbrk(0)) == (void *)-1)
+      return -1;
+    heap_granules = 0;
+    rover = 0;
+    return 0;
+}
+
+/*
+ * next_bit - First granule from g on whose bit in map, XOR flip, is set,
+ *     or heap_granules if there is none. Pass flip ~0UL to find clear bits.
+ *     Bits past the break are clear in both bitmaps.
+ */
+static size_t next_bit(unsigned long *map, unsigned long flip, size_t g)
+{
+  if (g >= heap_granules)
+    return heap_granules;
+  size_t i = g / 64;
+  unsigned long word = (map[i] ^ flip) & (~0UL << (g % 64));
+  while (word == 0) {
+    if (++i * 64 >= heap_granules)
+      return heap_granules;
+    word = map[i] ^ flip;
+  }
+  return MIN(i * 64 + __builtin_ctzl(word), heap_granules);
+}
+
+/*
+ * block_end - One past the last granule of the allocated block starting at
+ *     g: the next granule that starts another block or is free.
+ */
+static size_t block_end(size_t g)
+{
+  size_t i = (g + 1) / 64;
+  unsigned long word;
+
+  if (g + 1 >= heap_granules)
+    return heap_granules;
+  word = (start_map[i] | ~alloc_map[i]) & (~0UL << ((g + 1) % 64));
+  while (word == 0) {
+    if (++i * 64 >= heap_granules)
+      return heap_granules;
+    word = start_map[i] | ~alloc_map[i];
+  }
+  return MIN(i * 64 + __builtin_ctzl(word), heap_granules);
+}
+
+/* set_range - Set, or clear, the bits of granules lo to hi - 1 */
+static void set_range(unsigned long *map, size_t lo, size_t hi, int set)
+{
+  while (lo < hi) {
+    size_t i = lo / 64;
+    size_t end = MIN(hi, (i + 1) * 64);
+    unsigned long mask = end - lo == 64 ? ~0UL : ((1UL << (end - lo)) - 1) << (lo % 64);
+    if (set)
+      map[i] |= mask;
+    else
+      map[i] &= ~mask;
+    lo = end;
+  }
+}
+
+/*
+ * find_fit - First run of at least n free granules that starts between
+ *     from and to. Each step skips a whole run, free or allocated, with one
+ *     ctz per bitmap word. If the search reaches the break inside a free
+ *     run, *top is set to where that run starts.
+ */
+static size_t find_fit(size_t n, size_t from, size_t to, size_t *top)
+{
+  size_t lo = from;
+
+  while ((lo = next_bit(alloc_map, ~0UL, lo)) < to) {
+    size_t hi = next_bit(alloc_map, 0, lo);
+    if (hi - lo >= n)
+      return lo;
+    if (hi == heap_granules)
+      *top = lo;
+    lo = hi;
+  }
+  return NO_FIT;
+}
+
+/*
+ * extend_heap - Add n free granules at the top of the heap.
+ */
+static int extend_heap(size_t n)
+{
+  if ((heap_granules + n) * GSIZE > BITMAP_HEAP)
+    return -1;
+  if (mem_sbrk(n * GSIZE) == (void *)-1)
+    return -1;
+  heap_granules += n;
+  return 0;
+}
+
+/*
+ * mm_malloc - Claim a run of free granules, searching from where the last
+ *     block was placed and wrapping around once.
+ */
+void *mm_malloc(size_t size)
+{
+  size_t n, g, top;
+
+  /* Ignore spurious requests */
+  if (size == 0)
+    return NULL;
+
+  n = GRANULES(size);
+  top = heap_granules;
+  if ((g = find_fit(n, rover, heap_granules, &top)) == NO_FIT
+      && (g = find_fit(n, 0, rover, &top)) == NO_FIT) {
+    /* No fit found. Grow the free run at the top, if any, to fit */
+    size_t need = n - (heap_granules - top);
+    if (extend_heap(MAX(need, CHUNKSIZE / GSIZE)) == -1)
+      return NULL;
+    g = top;
+  }
+
+  set_range(alloc_map, g, g + n, 1);
+  SET_BIT(start_map, g);
+  rover = g + n;
+  return ADDRESS(g);
+}
+
+/*
+ * mm_free - Clear the block's bits. Nothing in the heap is read or written.
+ */
+void mm_free(void *ptr)
+{
+  size_t g = GRANULE(ptr);
+
+  set_range(alloc_map, g, block_end(g), 0);
+  CLEAR_BIT(start_map, g);
+}
+
+/*
+ * mm_realloc - Shrink in place by clearing the tail. Grow in place while
+ *     the granules that follow are free, growing the heap if the block
+ *     reaches the break. Otherwise, move it with mm_malloc and mm_free.
+ */
+void *mm_realloc(void *ptr, size_t size)
+{
+  size_t g, end, hi, n;
+  void *newptr;
+
+  if (ptr == NULL)
+    return mm_malloc(size);
+  if (size == 0) {
+    mm_free(ptr);
+    return NULL;
+  }
+
+  g = GRANULE(ptr);
+  end = block_end(g);
+  n = GRANULES(size);
+  if (n <= end - g) {
+    set_range(alloc_map, g + n, end, 0);
+    return ptr;
+  }
+
+  hi = next_bit(alloc_map, 0, end);
+  if (hi == heap_granules && hi - g < n && extend_heap(n - (hi - g)) == 0)
+    hi = heap_granules;
+  if (hi - g >= n) {
+    set_range(alloc_map, end, g + n, 1);
+    return ptr;
+  }
+
+  if ((newptr = mm_malloc(size)) == NULL)
+    return NULL;
+  memcpy(newptr, ptr, (end - g) * GSIZE);
+  mm_free(ptr);
+  return newptr;
+}
@@ -0,0 +1,249 @@
+/*
+ * mm-buddy.c - Binary buddy system, for predictable coalescing.
+ *
+ * Every block is a power of two bytes, aligned to its size
+ * relative to the start of the heap;
+ * every block has a header with its size and allocated bit;
+ * free blocks have pred and succ fields with 32 bit pointers;
+ * One LIFO free list per order, and a bitmap of non-empty lists;
+ * Split in halves until the block is the smallest order that fits;
+ * Coalesce with the buddy, whose offset is the block's XOR its size;
+ * Realloc grows in place by absorbing free buddies.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+#include <string.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+team_t team = {"ateam", "Lucas", "fake@email.com", "", ""};
+
+#define WSIZE 4 /* Word and header size (bytes) */
+#define DSIZE 8 /* Double word size (bytes) */
+#ifndef MIN_ORDER
+#define MIN_ORDER 4 /* Smallest block, room for header, pred and succ; 12 stops sub-page splits */
+#endif
+#if MIN_ORDER < 4
+#error "MIN_ORDER blocks must hold a header, pred and succ"
+#endif
+#define MAX_ORDER 30 /* Largest block */
+/* Pack a size and allocated bit into a word */
+#define PACK(size, alloc) ((size) | (alloc))
+/* Read and write a word at address p */
+#define GET_WORD(p) (*(unsigned int *)(p))
+#define PUT_WORD(p, val) (*(unsigned int *)(p) = (val))
+/* Read the size and allocated fields from address p */
+#define GET_SIZE(p) (GET_WORD(p) & ~0x7)
+#define GET_ALLOC(p) (GET_WORD(p) & 0x1)
+/* Blocks are addressed by their header; the payload follows it */
+#define PAYLOAD(blk) ((char *)(blk) + WSIZE)
+#define BLOCK(ptr) ((char *)(ptr) - WSIZE)
+/* Given free block blk, compute address of its pred and succ fields */
+#define PRED(blk) ((char *)(blk) + WSIZE)
+#define SUCC(blk) ((char *)(blk) + DSIZE)
+/* Given block blk of order k, compute address of its buddy */
+#define OFFSET(blk) ((unsigned int)((char *)(blk) - heap_base))
+#define BUDDY(blk, k) (heap_base + (OFFSET(blk) ^ (1u << (k))))
+/* Order of a block size, and smallest order that holds size bytes */
+#define ORDER(size) (__builtin_ctz(size))
+#define FIT_ORDER(size) (32 - __builtin_clz((unsigned int)(size) - 1))
+
+static char *extend_heap(int k);
+static void push(char *blk, int k);
+static void pop(char *blk, int k);
+static void release(char *blk, int k);
+static char *heap_base; // Offset 0 for buddy computations.
+static unsigned int heap_size; // Bytes from heap_base to the break.
+static char *free_lists[MAX_ORDER+1]; // One free list per order.
+static unsigned int nonempty; // Bit k is set if free_lists[k] has blocks.
+
+/*
+ * mm_init - initialize the malloc package.
+ */
+int mm_init(void)
+{
+    /* Padding, so that payloads after the headers are aligned: to pages if
+       no block is smaller than one, so that each page-sized payload sits in
+       a single page, and to double words otherwise */
+    size_t align = MIN_ORDER >= 12 ? mem_pagesize() : DSIZE;
+    char *brk = (char *)mem_heap_hi() + 1;
+    size_t pad = -(unsigned long)(brk + WSIZE) & (align-1);
+
+    if ((heap_base = mem_sbrk(pad)) == (void *)-1)
+      return -1;
+    heap_base += pad;
+    heap_size = 0;
+    memset(free_lists, 0, sizeof(free_lists));
+    nonempty = 0;
+    return 0;
+}
+
+/*
+ * extend_heap - Add a block of order k at the top of the heap. The break
+ *     is first aligned to the block size, by adding free blocks the size
+ *     of its lowest set bit.
+ */
+static char *extend_heap(int k)
+{
+  unsigned int size = 1u << k;
+  char *blk;
+
+  while (heap_size & (size-1)) {
+    unsigned int fill = heap_size & -heap_size;
+    if ((blk = mem_sbrk(fill)) == (void *)-1)
+      return NULL;
+    heap_size += fill;
+    release(blk, ORDER(fill));
+  }
+  if ((blk = mem_sbrk(size)) == (void *)-1)
+    return NULL;
+  heap_size += size;
+  return blk;
+}
+
+/*
+ * mm_malloc - Take the smallest free block of a large enough order,
+ *     splitting off halves until it is the order the request needs.
+ */
+void *mm_malloc(size_t size)
+{
+  int k, j;
+  char *blk;
+
+  /* Ignore spurious requests */
+  if (size == 0)
+    return NULL;
+
+  /* Adjust block size to include the header */
+  if (size > (1u << MAX_ORDER) - WSIZE)
+    return NULL;
+  k = FIT_ORDER(size + WSIZE);
+  if (k < MIN_ORDER)
+    k = MIN_ORDER;
+
+  /* Lowest non-empty list of order k or more */
+  unsigned int avail = nonempty & ~((1u << k) - 1);
+  if (avail) {
+    j = __builtin_ctz(avail);
+    blk = free_lists[j];
+    pop(blk, j);
+  } else {
+    j = k;
+    if ((blk = extend_heap(k)) == NULL)
+      return NULL;
+  }
+
+  /* Split, freeing the high halves */
+  while (j > k) {
+    j--;
+    PUT_WORD(blk + (1u << j), PACK(1u << j, 0));
+    push(blk + (1u << j), j);
+  }
+  PUT_WORD(blk, PACK(1u << k, 1));
+  return PAYLOAD(blk);
+}
+
+/*
+ * mm_free - Free and coalesce with the buddy, as long as it is free.
+ */
+void mm_free(void *ptr)
+{
+  char *blk = BLOCK(ptr);
+  release(blk, ORDER(GET_SIZE(blk)));
+}
+
+/*
+ * release - Merge a block of order k with its buddies while they are
+ *     whole and free, then add the result to its list. A buddy is whole and
+ *     free when its header has the same size and a clear allocated bit;
+ *     if it was split, the header there belongs to a smaller block.
+ */
+static void release(char *blk, int k)
+{
+  while (k < MAX_ORDER) {
+    char *buddy = BUDDY(blk, k);
+    if (OFFSET(buddy) + (1u << k) > heap_size || GET_WORD(buddy) != PACK(1u << k, 0))
+      break;
+    pop(buddy, k);
+    if (buddy < blk)
+      blk = buddy;
+    k++;
+  }
+  PUT_WORD(blk, PACK(1u << k, 0));
+  push(blk, k);
+}
+
+static void push(char *blk, int k)
+{
+  // Connect to list using LIFO
+  if (free_lists[k] != NULL) PUT_WORD(PRED(free_lists[k]), (unsigned int) blk);
+  PUT_WORD(SUCC(blk), (unsigned int) free_lists[k]);
+  PUT_WORD(PRED(blk), (unsigned int) NULL);
+  free_lists[k] = blk;
+  nonempty |= 1u << k;
+}
+
+static void pop(char *blk, int k)
+{
+  unsigned int pred = GET_WORD(PRED(blk));
+  unsigned int succ = GET_WORD(SUCC(blk));
+  if (pred != (unsigned int) NULL) PUT_WORD(SUCC(pred), (unsigned int) succ);
+  else free_lists[k] = (char *) succ;
+  if (succ != (unsigned int) NULL) PUT_WORD(PRED(succ), (unsigned int) pred);
+  if (free_lists[k] == NULL)
+    nonempty &= ~(1u << k);
+}
+
+/*
+ * mm_realloc - Stay in place while the request fits the block. A block
+ *     that is the low half of its pair can double by absorbing a free
+ *     buddy, or by growing the heap if it is the last block. Otherwise,
+ *     move it with mm_malloc and mm_free.
+ */
+void *mm_realloc(void *ptr, size_t size)
+{
+  char *blk;
+  int k;
+  void *newptr;
+  size_t copySize;
+
+  if (ptr == NULL)
+    return mm_malloc(size);
+  if (size == 0) {
+    mm_free(ptr);
+    return NULL;
+  }
+
+  blk = BLOCK(ptr);
+  k = ORDER(GET_SIZE(blk));
+
+  while ((1u << k) - WSIZE < size && k < MAX_ORDER && !(OFFSET(blk) & (1u << k))) {
+    char *buddy = BUDDY(blk, k);
+    if (OFFSET(buddy) == heap_size) {
+      if (mem_sbrk(1u << k) == (void *)-1)
+        break;
+      heap_size += 1u << k;
+    } else if (GET_WORD(buddy) == PACK(1u << k, 0)) {
+      pop(buddy, k);
+    } else {
+      break;
+    }
+    k++;
+  }
+  PUT_WORD(blk, PACK(1u << k, 1));
+  if (size <= (1u << k) - WSIZE)
+    return ptr;
+
+  newptr = mm_malloc(size);
+  if (newptr == NULL)
+    return NULL;
+  copySize = (1u << k) - WSIZE;
+  if (size < copySize)
+    copySize = size;
+  memcpy(newptr, ptr, copySize);
+  mm_free(ptr);
+  return newptr;
+}
@@ -8,7 +8,8 @@
  * First-fit policy w/ LIFO list;
  * Split when there's at least a min length left;
  * Coalesce both neighbors using header/footer;
- * Realloc uses malloc and free.
+ * Realloc uses malloc and free;
+ * With MM_CHECK=n, calls check the next n blocks of the heap.
  */
 #include <stdio.h>
 #include <stdlib.h>
@@ -18,6 +19,7 @@
 
 #include "mm.h"
 #include "memlib.h"
+#include "mm_heapmap.h"
 
 team_t team = {"ateam", "Lucas", "fake@email.com", "", ""};
 
@@ -50,6 +52,21 @@ static void place(void *bp, size_t asize);
 static void *coalesce(void *bp);
 static char *heap_listp; // Points to prologue block.
 static char *free_list; // Points to start of the free list.
+#ifdef MM_CHECK
+#ifndef MM_CHECK_PERIOD
+#define MM_CHECK_PERIOD 1 /* Calls per check_step */
+#endif
+static void check_step(void);
+static void check_fail(char *bp, const char *what);
+static char *check_cursor; // Next block to check, or NULL to start over.
+static unsigned long check_calls; // Calls to mm_malloc and mm_free.
+#define CHECK_STEP() check_step()
+/* A block merged into the one before it hands the cursor to that block */
+#define CHECK_ABSORB(bp, into) do { if (check_cursor == (bp)) check_cursor = (into); } while (0)
+#else
+#define CHECK_STEP() do { } while (0)
+#define CHECK_ABSORB(bp, into) do { } while (0)
+#endif
 
 /* 
  * mm_init - initialize the malloc package.
@@ -63,6 +80,9 @@ int mm_init(void)
     PUT_WORD(heap_listp + (1*WSIZE), PACK(DSIZE, 1, 0)); /* Prologue header */
     PUT_WORD(heap_listp + (3*WSIZE), PACK(0, 1, 1));     /* Epilogue header */
     heap_listp += (2*WSIZE);
+#ifdef MM_CHECK
+    check_cursor = NULL;
+#endif
     
     /* Extend the empty heap with a free block of CHUNKSIZE bytes */
     if (extend_heap(CHUNKSIZE/WSIZE) == NULL)
@@ -106,6 +126,8 @@ void *mm_malloc(size_t size)
   size_t asize;      /* Adjusted block size */
   size_t extendsize; /* Amount to extend heap if no fit */
   char *bp;
+  HEAPMAP_TICK();
+  CHECK_STEP();
 
   /* Ignore spurious requests */
   if (size == 0)
@@ -188,6 +210,8 @@ static void place(void *bp, size_t asize)
  */
 void mm_free(void *ptr)
 {
+  HEAPMAP_TICK();
+  CHECK_STEP();
   char *hdrp = HDRP(ptr);
   size_t size = GET_SIZE(hdrp);
   int prev_alloc = GET_PREV_ALLOC(hdrp);
@@ -224,6 +248,7 @@ static void *coalesce(void *bp)
 
     char *new_next = NEXT_BLKP(bp);
     PUT_WORD(HDRP(new_next), PACK(GET_SIZE(HDRP(new_next)), 1, 0));
+    CHECK_ABSORB(next, bp);
 
     unsigned int pred = GET_WORD(PRED(next));
     unsigned int succ = GET_WORD(SUCC(next));
@@ -236,6 +261,7 @@ static void *coalesce(void *bp)
     size += GET_SIZE(HDRP(PREV_BLKP(bp)));
     PUT_WORD(FTRP(bp), PACK(size, 0, 1));
     PUT_WORD(HDRP(PREV_BLKP(bp)), PACK(size, 0, 1));
+    CHECK_ABSORB(bp, prev);
     bp = PREV_BLKP(bp);
 
     PUT_WORD(HDRP(next), PACK(GET_SIZE(HDRP(next)), next_alloc, 0));
@@ -251,6 +277,8 @@ static void *coalesce(void *bp)
     size += GET_SIZE(HDRP(PREV_BLKP(bp))) + GET_SIZE(FTRP(NEXT_BLKP(bp)));
     PUT_WORD(HDRP(PREV_BLKP(bp)), PACK(size, 0, 1));
     PUT_WORD(FTRP(NEXT_BLKP(bp)), PACK(size, 0, 1));
+    CHECK_ABSORB(bp, prev);
+    CHECK_ABSORB(next, prev);
     bp = PREV_BLKP(bp);
 
     char *new_next = NEXT_BLKP(bp);
@@ -271,6 +299,91 @@ static void *coalesce(void *bp)
   return bp;
 }
 
+/*
+ * mm_heap_snapshot - Write the offset, size and allocated bit of every
+ *     block, walking from the prologue to the epilogue, to a heap map file.
+ */
+int mm_heap_snapshot(const char *path)
+{
+  char *heap_lo = heap_listp - DSIZE;
+  unsigned int nblocks = 0;
+  char *bp;
+  FILE *f;
+
+  if ((f = heapmap_open(path, "first-fit", mem_pagesize())) == NULL)
+    return -1;
+  for (bp = NEXT_BLKP(heap_listp); GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp), nblocks++)
+    heapmap_block(f, HDRP(bp) - heap_lo, GET_SIZE(HDRP(bp)), GET_ALLOC(HDRP(bp)));
+  return heapmap_close(f, bp - heap_lo, nblocks);
+}
+
+#ifdef MM_CHECK
+/*
+ * check_step - Every MM_CHECK_PERIOD calls, check the next MM_CHECK
+ *     blocks, picking up where the last check stopped and wrapping around
+ *     at the epilogue. Allocated blocks have no footer, so the prev_alloc
+ *     bit of the block after each one is all that records it; it must
+ *     match. A free block must match its footer, have allocated neighbors,
+ *     and be linked back to by its pred and succ.
+ */
+static void check_step(void)
+{
+  char *brk = (char *)mem_heap_hi() + 1;
+  char *bp = check_cursor ? check_cursor : heap_listp;
+  char *start = bp;
+
+  if (++check_calls % (MM_CHECK_PERIOD) != 0)
+    return;
+
+  /* At most one lap, however big the budget */
+  for (int budget = MM_CHECK; budget > 0; budget--) {
+    char *hdrp = HDRP(bp);
+    size_t size = GET_SIZE(hdrp);
+    char *next = bp + size;
+
+    if (size == 0) {
+      if (hdrp != brk - WSIZE || !GET_ALLOC(hdrp))
+        check_fail(bp, "epilogue isn't at the break");
+      bp = heap_listp;
+      if (bp == start)
+        break;
+      continue;
+    }
+    if (size % DSIZE != 0 || HDRP(next) > brk - WSIZE)
+      check_fail(bp, "size runs past the break");
+    if (GET_PREV_ALLOC(HDRP(next)) != GET_ALLOC(hdrp))
+      check_fail(bp, "next block's prev_alloc bit is wrong");
+    if (!GET_ALLOC(hdrp)) {
+      char *pred = (char *) GET_WORD(PRED(bp));
+      char *succ = (char *) GET_WORD(SUCC(bp));
+      if (size < 2*DSIZE || GET_SIZE(FTRP(bp)) != size || GET_ALLOC(FTRP(bp)))
+        check_fail(bp, "header and footer disagree");
+      if (!GET_ALLOC(HDRP(next)))
+        check_fail(bp, "free neighbors weren't coalesced");
+      if (pred != NULL && (pred <= heap_listp || pred >= brk || GET_ALLOC(HDRP(pred))
+                           || (char *) GET_WORD(SUCC(pred)) != bp))
+        check_fail(bp, "pred doesn't link back");
+      if (pred == NULL && free_list != bp)
+        check_fail(bp, "no pred, but not the head of the free list");
+      if (succ != NULL && (succ <= heap_listp || succ >= brk || GET_ALLOC(HDRP(succ))
+                           || (char *) GET_WORD(PRED(succ)) != bp))
+        check_fail(bp, "succ doesn't link back");
+    }
+    if ((bp = next) == start)
+      break;
+  }
+  check_cursor = bp;
+}
+
+/* check_fail - Report a corrupt block, by its offset as in heap maps */
+static void check_fail(char *bp, const char *what)
+{
+  fprintf(stderr, "mm_check: block at offset %ld, header %#x: %s\n",
+          (long)(HDRP(bp) - (heap_listp - DSIZE)), GET_WORD(HDRP(bp)), what);
+  abort();
+}
+#endif
+
 // TODO
 /*
  * mm_realloc - Implemented simply in terms of mm_malloc and mm_free
@@ -0,0 +1,35 @@
+/*
+ * mm_ext.h - Interfaces that mm_best_fit.c provides beyond mm.h.
+ */
+#ifndef MM_EXT_H
+#define MM_EXT_H
+
+#include <stdio.h>
+
+extern void *mm_calloc (size_t nmemb, size_t size);
+/* Resize a block that is expected to keep growing up to expected_max */
+extern void *mm_realloc_hint (void *ptr, size_t size, size_t expected_max);
+/* Heap size, which mem_heapsize doesn't know under MM_HUGEPAGE or MM_PERSIST */
+extern size_t mm_heapsize (void);
+
+/* Relocatable blocks: lock a handle to get its address, 0 is no handle */
+typedef unsigned int mm_handle_t;
+extern mm_handle_t mm_halloc (size_t size);
+extern void *mm_hlock (mm_handle_t h);
+extern void mm_hunlock (mm_handle_t h);
+extern void mm_hfree (mm_handle_t h);
+extern size_t mm_compact (void);
+#ifdef MM_PERSIST
+extern int mm_open (const char *path);
+extern int mm_sync (void);
+extern void mm_set_root (void *root);
+extern void *mm_get_root (void);
+#endif
+#ifdef MM_PROFILE
+extern void mm_prof_dump (FILE *out);
+#endif
+#ifdef MM_SAMPLE
+extern void mm_sample_dump (FILE *out);
+#endif
+
+#endif
@@ -0,0 +1,93 @@
+/*
+ * mm_heapmap.h - Heap snapshots, for looking at fragmentation offline.
+ *
+ * mm_heap_snapshot walks the heap block by block, from the prologue to the
+ * epilogue, and writes every block's offset, size and allocated bit to a
+ * binary file. heapmap.c reads such files and draws them. Built with
+ * -DMM_HEAPMAP=n, an allocator also writes heapmap.NNNN.bin every n calls
+ * to mm_malloc and mm_free.
+ */
+#ifndef MM_HEAPMAP_H
+#define MM_HEAPMAP_H
+
+#include <stdio.h>
+#include <string.h>
+
+#define HEAPMAP_MAGIC 0x50414d48 /* "HMAP" */
+#define HEAPMAP_VERSION 1
+
+/* File header, followed by nblocks struct heapmap_block records */
+struct heapmap_header {
+  unsigned int magic;
+  unsigned int version;
+  unsigned int pagesize;
+  unsigned int heapsize; /* From the alignment padding to the epilogue */
+  unsigned int nblocks;
+  char policy[12];       /* Placement policy of the allocator */
+};
+
+struct heapmap_block {
+  unsigned int offset;   /* Of the block header, from the start of the heap */
+  unsigned int size;     /* Block size, with the allocated bit in bit 0 */
+};
+
+extern int mm_heap_snapshot (const char *path);
+
+/* Writer side, used by the allocators */
+static inline FILE *heapmap_open(const char *path, const char *policy,
+                                 unsigned int pagesize)
+{
+  struct heapmap_header h = {HEAPMAP_MAGIC, HEAPMAP_VERSION, pagesize, 0, 0, ""};
+  FILE *f;
+
+  strncpy(h.policy, policy, sizeof(h.policy) - 1);
+  if ((f = fopen(path, "w+b")) == NULL)
+    return NULL;
+  fwrite(&h, sizeof(h), 1, f);
+  return f;
+}
+
+static inline void heapmap_block(FILE *f, unsigned int offset,
+                                 unsigned int size, unsigned int alloc)
+{
+  struct heapmap_block b = {offset, size | alloc};
+  fwrite(&b, sizeof(b), 1, f);
+}
+
+/* Fill in the totals, which are only known after the walk */
+static inline int heapmap_close(FILE *f, unsigned int heapsize,
+                                unsigned int nblocks)
+{
+  struct heapmap_header h;
+
+  rewind(f);
+  if (fread(&h, sizeof(h), 1, f) != 1) {
+    fclose(f);
+    return -1;
+  }
+  h.heapsize = heapsize;
+  h.nblocks = nblocks;
+  rewind(f);
+  fwrite(&h, sizeof(h), 1, f);
+  return fclose(f) == 0 ? 0 : -1;
+}
+
+#ifdef MM_HEAPMAP
+static unsigned long heapmap_ops;
+static unsigned int heapmap_seq;
+
+static inline void heapmap_tick(void)
+{
+  char path[32];
+
+  if (++heapmap_ops % (MM_HEAPMAP) != 0)
+    return;
+  snprintf(path, sizeof(path), "heapmap.%04u.bin", heapmap_seq++);
+  mm_heap_snapshot(path);
+}
+#define HEAPMAP_TICK() heapmap_tick()
+#else
+#define HEAPMAP_TICK() do { } while (0)
+#endif
+
+#endif
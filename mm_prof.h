@@ -0,0 +1,74 @@
+/*
+ * mm_prof.h - Cycle counts for the allocator's hot paths.
+ *
+ * Built with -DMM_PROFILE, every function that opens a PROF_SCOPE adds the
+ * rdtsc cycles it took, from entry to whichever return it leaves by, to a
+ * log2 histogram. PROF_VISIT counts free list nodes visited, which are
+ * recorded per find_fit call. The histograms are thread local. Without
+ * MM_PROFILE, the macros compile to nothing.
+ */
+#ifndef MM_PROF_H
+#define MM_PROF_H
+
+#ifdef MM_PROFILE
+#include <stdio.h>
+#include <x86intrin.h>
+
+enum prof_fn {
+  PROF_MALLOC, PROF_FIND_FIT, PROF_PLACE,
+  PROF_COALESCE, PROF_EXTEND_HEAP, PROF_FREE, PROF_NFNS
+};
+static const char *prof_names[PROF_NFNS] = {
+  "mm_malloc", "find_fit", "place", "coalesce", "extend_heap", "mm_free"
+};
+
+#define PROF_BUCKETS 40 /* Bucket i counts samples in [2^i, 2^(i+1)) */
+
+struct prof_scope {
+  enum prof_fn fn;
+  unsigned long long start;
+};
+
+static __thread struct {
+  unsigned long long cycles[PROF_NFNS][PROF_BUCKETS];
+  unsigned long long visits[PROF_BUCKETS];
+  unsigned long long visiting; /* Nodes visited by the current find_fit */
+} prof;
+
+static inline int prof_bucket(unsigned long long n)
+{
+  int b = 63 - __builtin_clzll(n | 1);
+  return b < PROF_BUCKETS ? b : PROF_BUCKETS - 1;
+}
+
+static inline void prof_leave(struct prof_scope *scope)
+{
+  prof.cycles[scope->fn][prof_bucket(__rdtsc() - scope->start)]++;
+  if (scope->fn == PROF_FIND_FIT) {
+    prof.visits[prof_bucket(prof.visiting)]++;
+    prof.visiting = 0;
+  }
+}
+
+/* Write the calling thread's histograms as CSV: metric,function,from,count */
+static void prof_dump(FILE *out)
+{
+  fprintf(out, "metric,function,from,count\n");
+  for (int fn = 0; fn < PROF_NFNS; fn++)
+    for (int b = 0; b < PROF_BUCKETS; b++)
+      if (prof.cycles[fn][b])
+        fprintf(out, "cycles,%s,%llu,%llu\n", prof_names[fn], 1ULL << b, prof.cycles[fn][b]);
+  for (int b = 0; b < PROF_BUCKETS; b++)
+    if (prof.visits[b])
+      fprintf(out, "visits,find_fit,%llu,%llu\n", b ? 1ULL << b : 0, prof.visits[b]);
+}
+
+#define PROF_SCOPE(fn) \
+  struct prof_scope prof_scope __attribute__((cleanup(prof_leave))) = {(fn), __rdtsc()}
+#define PROF_VISIT() (prof.visiting++)
+#else
+#define PROF_SCOPE(fn)
+#define PROF_VISIT() do { } while (0)
+#endif
+
+#endif
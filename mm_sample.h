@@ -0,0 +1,303 @@
+/*
+ * mm_sample.h - Sampled allocation profiles, by call site.
+ *
+ * Built with -DMM_SAMPLE=n, one in every n bytes allocated, on average, is
+ * sampled, as in tcmalloc: a countdown of bytes is drawn from an
+ * exponential distribution with mean n, and the allocation that takes it
+ * below zero captures a backtrace. Each sample stands for the bytes it is
+ * expected to represent, size / (1 - e^(-size/n)), so small blocks, which
+ * are sampled less often, count for more. Samples are grouped by stack in
+ * a site table. A side table maps each live sampled block to its site, so
+ * that freeing it takes its bytes off the site's live total. Without
+ * MM_SAMPLE, the macros do nothing; with it, an unsampled
+ * allocation costs a subtraction and a branch, and a free a probe of the
+ * side table while any sample is live.
+ */
+#ifndef MM_SAMPLE_H
+#define MM_SAMPLE_H
+
+#ifdef MM_SAMPLE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+
+#define SAMPLE_DEPTH 16 /* Frames kept per stack */
+#define SAMPLE_SKIP 2 /* Frames of sample_alloc and the allocator entry point */
+#define SAMPLE_SITES 1024 /* Distinct stacks; the rest are counted in site 0 */
+#define SAMPLE_LIVE (1<<14) /* Live samples the side table can hold */
+#define SAMPLE_LN2 0.6931471805599453
+
+struct sample_site {
+  unsigned long long hash;   /* Of the frames, 0 if the slot is unused */
+  int depth;
+  void *frames[SAMPLE_DEPTH];
+  double alloc_bytes;        /* Estimated bytes allocated here */
+  double alloc_objects;
+  double live_bytes;         /* Estimated bytes allocated here and not freed */
+  double live_objects;
+  size_t size_lo, size_hi;   /* Range of sampled request sizes */
+};
+
+struct sample_live {
+  void *bp;                  /* Sampled block, NULL if the slot is empty */
+  unsigned int site;
+  size_t size;
+  double weight;             /* Bytes the sample stands for */
+};
+
+static struct sample_site sample_sites[SAMPLE_SITES];
+static struct sample_live sample_live[SAMPLE_LIVE];
+static unsigned int sample_nlive; // Entries in sample_live.
+static long sample_left; // Bytes left to allocate before the next sample.
+static unsigned long long sample_rng = 88172645463325252ULL;
+static struct timespec sample_start; // When the profile was last reset.
+
+/*
+ * sample_log2 - log2(x) for x > 0, within about 0.01, from the float bits.
+ *     Exact at powers of two, up to rounding, so log2(1) is about 0.
+ */
+static inline float sample_log2(float x)
+{
+  union { float f; unsigned int i; } v = {x}, m;
+
+  m.i = (v.i & 0x007fffff) | 0x3f800000; /* Mantissa, in [1, 2) */
+  /* The polynomial is 1 + log2 of the mantissa, hence the bias of 128; it
+     is 1 at 1 and 2 at 2 */
+  return (int)(v.i >> 23) - 128 + (-0.3466f * m.f + 2.0398f) * m.f - 0.6932f;
+}
+
+/* sample_next - Bytes until the next sample, exponential with mean MM_SAMPLE */
+static inline long sample_next(void)
+{
+  float u;
+  long n;
+
+  sample_rng ^= sample_rng << 13;
+  sample_rng ^= sample_rng >> 7;
+  sample_rng ^= sample_rng << 17;
+  u = ((sample_rng >> 40) + 1) / (float)(1 << 24); /* In (0, 1] */
+  n = (long)(-sample_log2(u) * SAMPLE_LN2 * (MM_SAMPLE)) + 1;
+  return n > 0 ? n : 1; /* log2 of u near 1 can still round above 0 */
+}
+
+/*
+ * sample_prob - 1 - e^-t, the chance that a block of t mean intervals gets
+ *     sampled. e^-t is split into 2^-k e^-r with r < ln 2, where a short
+ *     series is accurate, and for k = 0 the series gives 1 - e^-r directly,
+ *     without the cancellation.
+ */
+static double sample_prob(double t)
+{
+  double term = 1, em1 = 0; /* e^-r - 1 */
+  int k;
+
+  if (t > 40)
+    return 1;
+  k = (int)(t / SAMPLE_LN2);
+  t -= k * SAMPLE_LN2;
+  for (int i = 1; i <= 8; i++) {
+    term *= -t / i;
+    em1 += term;
+  }
+  return k == 0 ? -em1 : 1 - (1 + em1) / (double)(1ULL << k);
+}
+
+static inline unsigned int sample_slot(void *bp)
+{
+  return ((unsigned long)bp >> 3) * 0x9e3779b97f4a7c15ULL >> 32 & (SAMPLE_LIVE - 1);
+}
+
+/* sample_find - Slot of bp in the side table, or of the empty slot ending its run */
+static unsigned int sample_find(void *bp)
+{
+  unsigned int i = sample_slot(bp);
+
+  while (sample_live[i].bp != NULL && sample_live[i].bp != bp)
+    i = (i + 1) & (SAMPLE_LIVE - 1);
+  return i;
+}
+
+/*
+ * sample_remove - Empty slot i of the side table. Later entries of its run
+ *     that hash at or before i move back, so lookups never stop early.
+ */
+static void sample_remove(unsigned int i)
+{
+  unsigned int j = i;
+
+  sample_nlive--;
+  for (;;) {
+    sample_live[i].bp = NULL;
+    for (;;) {
+      j = (j + 1) & (SAMPLE_LIVE - 1);
+      if (sample_live[j].bp == NULL)
+        return;
+      unsigned int home = sample_slot(sample_live[j].bp);
+      /* Entry j can move to i unless its home lies cyclically in (i, j] */
+      if (i <= j ? home <= i || home > j : home <= i && home > j)
+        break;
+    }
+    sample_live[i] = sample_live[j];
+    i = j;
+  }
+}
+
+/* sample_site - Site of a stack, added if new; site 0 once the table is full */
+static unsigned int sample_site(void **frames, int depth)
+{
+  unsigned long long hash = 14695981039346656037ULL;
+  unsigned int i;
+
+  for (int d = 0; d < depth; d++)
+    hash = (hash ^ (unsigned long)frames[d]) * 1099511628211ULL;
+  hash |= 1;
+  i = hash % (SAMPLE_SITES - 1) + 1;
+  for (int probes = 1; probes < SAMPLE_SITES; probes++) {
+    struct sample_site *s = &sample_sites[i];
+    if (s->hash == 0) {
+      s->hash = hash;
+      s->depth = depth;
+      memcpy(s->frames, frames, depth * sizeof(*frames));
+      return i;
+    }
+    if (s->hash == hash && s->depth == depth
+        && memcmp(s->frames, frames, depth * sizeof(*frames)) == 0)
+      return i;
+    i = i % (SAMPLE_SITES - 1) + 1;
+  }
+  return 0;
+}
+
+/*
+ * sample_alloc - Record a sample for block bp of size bytes, then draw the
+ *     next countdown. Not inlined, so the frames to skip are known.
+ */
+static __attribute__((noinline)) void sample_alloc(void *bp, size_t size)
+{
+  void *frames[SAMPLE_DEPTH + SAMPLE_SKIP];
+  int depth = backtrace(frames, SAMPLE_DEPTH + SAMPLE_SKIP) - SAMPLE_SKIP;
+  unsigned int site = sample_site(frames + SAMPLE_SKIP, depth > 0 ? depth : 0);
+  struct sample_site *s = &sample_sites[site];
+  double weight = size / sample_prob((double)size / (MM_SAMPLE));
+
+  sample_left = sample_next();
+  s->alloc_bytes += weight;
+  s->alloc_objects += weight / size;
+  s->live_bytes += weight;
+  s->live_objects += weight / size;
+  if (s->size_lo == 0 || size < s->size_lo)
+    s->size_lo = size;
+  if (size > s->size_hi)
+    s->size_hi = size;
+
+  /* Keep the side table at most 3/4 full; samples past that never retire */
+  if (sample_nlive < SAMPLE_LIVE / 4 * 3) {
+    unsigned int i = sample_find(bp);
+    sample_live[i] = (struct sample_live){bp, site, size, weight};
+    sample_nlive++;
+  }
+}
+
+/* sample_free - Retire the sample of bp, if it has one */
+static void sample_free(void *bp)
+{
+  unsigned int i = sample_find(bp);
+  struct sample_live *l = &sample_live[i];
+
+  if (l->bp == NULL)
+    return;
+  sample_sites[l->site].live_bytes -= l->weight;
+  sample_sites[l->site].live_objects -= l->weight / l->size;
+  sample_remove(i);
+}
+
+/* sample_move - Follow a sampled block that compaction moved */
+static void sample_move(void *from, void *to)
+{
+  unsigned int i = sample_find(from);
+  struct sample_live l = sample_live[i];
+
+  if (l.bp == NULL)
+    return;
+  sample_remove(i);
+  l.bp = to;
+  sample_live[sample_find(to)] = l;
+  sample_nlive++;
+}
+
+/* sample_reset - Forget every sample, for a fresh heap */
+static void sample_reset(void)
+{
+  memset(sample_sites, 0, sizeof(sample_sites));
+  memset(sample_live, 0, sizeof(sample_live));
+  sample_nlive = 0;
+  sample_left = sample_next();
+  clock_gettime(CLOCK_MONOTONIC, &sample_start);
+}
+
+static int sample_cmp(const void *a, const void *b)
+{
+  double x = sample_sites[*(const unsigned int *)a].live_bytes;
+  double y = sample_sites[*(const unsigned int *)b].live_bytes;
+  return x < y ? 1 : x > y ? -1 : 0;
+}
+
+/*
+ * sample_dump - Write the sites as CSV, most live bytes first. Bytes and
+ *     objects are estimates; the rate is per second since the last reset.
+ *     Frames are module+offset, innermost first, which addr2line -f -e
+ *     module takes as is.
+ */
+static void sample_dump(FILE *out)
+{
+  static unsigned int order[SAMPLE_SITES];
+  unsigned int n = 0;
+  struct timespec now;
+  double secs;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  secs = (now.tv_sec - sample_start.tv_sec) + (now.tv_nsec - sample_start.tv_nsec) / 1e9;
+  for (unsigned int i = 0; i < SAMPLE_SITES; i++)
+    if (sample_sites[i].alloc_objects > 0)
+      order[n++] = i;
+  qsort(order, n, sizeof(*order), sample_cmp);
+
+  fprintf(out, "live_bytes,live_objects,alloc_bytes,alloc_objects,alloc_bytes_per_sec,"
+          "size_lo,size_hi,stack\n");
+  for (unsigned int k = 0; k < n; k++) {
+    struct sample_site *s = &sample_sites[order[k]];
+    fprintf(out, "%.0f,%.0f,%.0f,%.0f,%.0f,%zu,%zu,", s->live_bytes, s->live_objects,
+            s->alloc_bytes, s->alloc_objects, secs > 0 ? s->alloc_bytes / secs : 0,
+            s->size_lo, s->size_hi);
+    if (order[k] == 0)
+      fprintf(out, "(other)");
+    for (int d = 0; d < s->depth; d++) {
+      Dl_info info;
+      if (dladdr(s->frames[d], &info) && info.dli_fname != NULL) {
+        const char *name = strrchr(info.dli_fname, '/');
+        fprintf(out, "%s%s+%#lx", d ? ";" : "", name ? name + 1 : info.dli_fname,
+                (unsigned long)((char *)s->frames[d] - (char *)info.dli_fbase));
+      } else {
+        fprintf(out, "%s%p", d ? ";" : "", s->frames[d]);
+      }
+    }
+    fputc('\n', out);
+  }
+}
+
+#define SAMPLE_ALLOC(bp, size) \
+  do { if ((bp) != NULL && (sample_left -= (long)(size)) < 0) sample_alloc((bp), (size)); } while (0)
+#define SAMPLE_FREE(bp) do { if (sample_nlive) sample_free(bp); } while (0)
+#define SAMPLE_MOVE(from, to) do { if (sample_nlive) sample_move((from), (to)); } while (0)
+#define SAMPLE_RESET() sample_reset()
+#else
+#define SAMPLE_ALLOC(bp, size) do { } while (0)
+#define SAMPLE_FREE(bp) do { } while (0)
+#define SAMPLE_MOVE(from, to) do { } while (0)
+#define SAMPLE_RESET() do { } while (0)
+#endif
+
+#endif
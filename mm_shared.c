@@ -0,0 +1,453 @@
+/*
+ * mm-shared.c - A heap shared by processes that map it at different
+ *    addresses, so that any of them can free what another allocated.
+ *
+ * Explicit w/ less footers, in a shared mapping:
+ * every block has a header;
+ * free blocks have footers;
+ * free blocks have pred and succ fields with 32 bit offsets from the
+ *     start of the mapping instead of pointers, as are the free list root
+ *     and the break, which live in the mapping's header;
+ * A process-shared robust mutex guards every call, and a process that
+ *     dies holding it poisons the heap;
+ * First-fit policy w/ LIFO list;
+ * Split when there's at least a min length left;
+ * Coalesce both neighbors using header/footer;
+ * Realloc uses malloc and free.
+ *
+ * mm_init gives a private heap on top of memlib, for the trace driver.
+ * mm_shm_create and mm_shm_attach put it in a shared memory object, from
+ * shm_open or memfd_create. Link with -lpthread.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "mm_shm.h"
+
+team_t team = {"ateam", "Lucas", "fake@email.com", "", ""};
+
+#define WSIZE 4 /* Word and header/footer size (bytes) */
+#define DSIZE 8 /* Double word size (bytes) */
+#define CHUNKSIZE (1<<12) /* Extend heap by this amount (bytes) */
+#define SHM_MAGIC 0x4d48534d /* "MSHM" */
+#define MAX(x, y) ((x) > (y)? (x) : (y))
+/* Pack a size and allocated bit into a word */
+#define PACK(size, alloc, prev_alloc) ((size) | (alloc) | (prev_alloc << 1))
+/* Read and write a word at address p */
+#define GET_WORD(p) (*(unsigned int *)(p))
+#define PUT_WORD(p, val) (*(unsigned int *)(p) = (val))
+/* Read the size and allocated fields from address p */
+#define GET_SIZE(p) (GET_WORD(p) & ~0x7)
+#define GET_ALLOC(p) (GET_WORD(p) & 0x1)
+#define GET_PREV_ALLOC(p) ((GET_WORD(p) & 0x2) >> 1)
+/* Given block ptr bp, compute address of its header and footer */
+#define HDRP(bp) ((char *)(bp) - WSIZE)
+#define FTRP(bp) ((char *)(bp) + GET_SIZE(HDRP(bp)) - DSIZE)
+/* Given free block ptr bp, compute address of its pred and succ fields */
+#define PRED(bp) ((char *)(bp))
+#define SUCC(bp) ((char *)(bp) + WSIZE)
+/* Given block ptr bp, compute address of next and previous blocks */
+#define NEXT_BLKP(bp) ((char *)(bp) + GET_SIZE(((char *)(bp) - WSIZE)))
+#define PREV_BLKP(bp) ((char *)(bp) - GET_SIZE(((char *)(bp) - DSIZE)))
+/* Convert between this process's pointers and offsets in the mapping */
+#define PTR(off) ((off) ? base + (off) : NULL)
+#define OFF(p) ((p) ? (unsigned int)((char *)(p) - base) : 0)
+
+/* Start of the mapping, holding everything the processes share */
+struct shm_header {
+  unsigned int magic;
+  unsigned int size;      /* Bytes mapped, or 0 for a memlib heap */
+  unsigned int brk;       /* Offset of the break */
+  unsigned int free_list; /* Offset of the first free block, or 0 */
+  pthread_mutex_t lock;
+};
+#define SHM_HDR_SIZE ((sizeof(struct shm_header) + (DSIZE-1)) & ~(DSIZE-1))
+
+static int heap_init(void);
+static void *shm_sbrk(size_t incr);
+static void *extend_heap(size_t words);
+static void *find_fit(size_t asize);
+static void place(void *bp, size_t asize);
+static void *coalesce(void *bp);
+static void push(char *bp);
+static void unlink_free(char *bp);
+static void *malloc_locked(size_t size);
+static void free_locked(void *ptr);
+static int shm_lock(void);
+static char *base; // This process's address of the mapping.
+static struct shm_header *shm; // The header, at base.
+
+/*
+ * mm_init - initialize the malloc package, in a private heap from memlib.
+ */
+int mm_init(void)
+{
+    if ((base = mem_sbrk(SHM_HDR_SIZE)) == (void *)-1)
+      return -1;
+    shm = (struct shm_header *)base;
+    shm->size = 0;
+    shm->brk = SHM_HDR_SIZE;
+    return heap_init();
+}
+
+/*
+ * mm_shm_create - Make a new heap of size bytes in the shared memory
+ *     object fd, and map it. Other processes then use mm_shm_attach.
+ *     Links are 32 bit offsets, so size must fit in 32 bits.
+ */
+int mm_shm_create(int fd, size_t size)
+{
+  if ((unsigned int) size != size) {
+    errno = EFBIG;
+    return -1;
+  }
+  if (ftruncate(fd, size) == -1)
+    return -1;
+  if ((base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+    return -1;
+  shm = (struct shm_header *)base;
+  shm->magic = 0;
+  shm->size = size;
+  shm->brk = SHM_HDR_SIZE;
+  return heap_init();
+}
+
+/*
+ * mm_shm_attach - Map a heap that another process made with
+ *     mm_shm_create. The address may differ from theirs.
+ */
+int mm_shm_attach(int fd)
+{
+  struct stat st;
+
+  if (fstat(fd, &st) == -1)
+    return -1;
+  if ((base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+    return -1;
+  shm = (struct shm_header *)base;
+  if (shm->magic != SHM_MAGIC || (off_t) shm->size != st.st_size) {
+    munmap(base, st.st_size);
+    return -1;
+  }
+  return 0;
+}
+
+/*
+ * mm_shm_offset, mm_shm_pointer - Hand a block to another process as an
+ *     offset, which means the same block in every mapping.
+ */
+unsigned int mm_shm_offset(void *ptr)
+{
+  return OFF(ptr);
+}
+
+void *mm_shm_pointer(unsigned int off)
+{
+  return PTR(off);
+}
+
+/*
+ * heap_init - Set up the lock and an empty heap after the header.
+ */
+static int heap_init(void)
+{
+    pthread_mutexattr_t attr;
+    char *heap_listp;
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&shm->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    /* Create the initial empty heap */
+    if ((heap_listp = shm_sbrk(4*WSIZE)) == (void *)-1)
+      return -1;
+    PUT_WORD(heap_listp, 0);                             /* Alignment padding */
+    PUT_WORD(heap_listp + (1*WSIZE), PACK(DSIZE, 1, 0)); /* Prologue header */
+    PUT_WORD(heap_listp + (3*WSIZE), PACK(0, 1, 1));     /* Epilogue header */
+    heap_listp += (2*WSIZE);
+
+    /* Extend the empty heap with a free block of CHUNKSIZE bytes */
+    shm->free_list = 0;
+    char *bp;
+    if ((bp = extend_heap(CHUNKSIZE/WSIZE)) == NULL)
+      return -1;
+    push(bp);
+
+    shm->magic = SHM_MAGIC;
+    return 0;
+}
+
+/*
+ * shm_sbrk - Move the shared break. A memlib heap grows with mem_sbrk,
+ *     a shared one within its mapping.
+ */
+static void *shm_sbrk(size_t incr)
+{
+  char *old_brk = base + shm->brk;
+
+  if (shm->size == 0) {
+    if (mem_sbrk(incr) == (void *)-1)
+      return (void *)-1;
+  } else if (incr > shm->size - shm->brk) {
+    return (void *)-1;
+  }
+  shm->brk += incr;
+  return old_brk;
+}
+
+/*
+ * shm_lock - Take the heap lock, or return -1 if the heap is poisoned.
+ *     If its owner died holding it, the heap may be half updated: a death
+ *     inside coalesce can leave an absorbed block on the free list, to be
+ *     handed out over live data. Nothing records what was in progress,
+ *     so the heap can't be repaired. The lock is released without being
+ *     marked consistent, which makes every later lock fail with
+ *     ENOTRECOVERABLE, and the magic is cleared so that no process
+ *     attaches to it. The heap has to be made again with mm_shm_create.
+ */
+static int shm_lock(void)
+{
+  int err = pthread_mutex_lock(&shm->lock);
+
+  if (err == EOWNERDEAD) {
+    shm->magic = 0;
+    pthread_mutex_unlock(&shm->lock);
+  }
+  return err == 0 ? 0 : -1;
+}
+
+static void *extend_heap(size_t words)
+{
+  char *bp;
+  size_t size;
+
+  /* Allocate an even number of words to maintain alignment */
+  size = (words % 2) ? (words+1) * WSIZE : words * WSIZE;
+  if ((long)(bp = shm_sbrk(size)) == -1)
+    return NULL;
+
+  int prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+
+  /* Initialize free block header/footer and the epilogue header */
+  PUT_WORD(HDRP(bp), PACK(size, 0, prev_alloc)); /* Free block header */
+  PUT_WORD(FTRP(bp), PACK(size, 0, prev_alloc)); /* Free block footer */
+  PUT_WORD(HDRP(NEXT_BLKP(bp)), PACK(0, 1, 0));  /* New epilogue header */
+
+  /* Coalesce if the previous block was free */
+  return coalesce(bp);
+}
+
+/*
+ * mm_malloc - Allocate a block under the heap lock, or return NULL if the
+ *     heap is poisoned.
+ */
+void *mm_malloc(size_t size)
+{
+  void *bp;
+
+  if (shm_lock() == -1)
+    return NULL;
+  bp = malloc_locked(size);
+  pthread_mutex_unlock(&shm->lock);
+  return bp;
+}
+
+static void *malloc_locked(size_t size)
+{
+  size_t asize;      /* Adjusted block size */
+  size_t extendsize; /* Amount to extend heap if no fit */
+  char *bp;
+
+  /* Ignore spurious requests */
+  if (size == 0)
+    return NULL;
+
+  /* Adjust block size to include overhead and alignment reqs. */
+  if (size <= DSIZE)
+    asize = 2*DSIZE;
+  else
+    asize = DSIZE * ((size + (WSIZE) + (DSIZE-1)) / DSIZE);
+
+  /* Search the free list for a fit */
+  if ((bp = find_fit(asize)) != NULL) {
+    place(bp, asize);
+    return bp;
+  }
+
+  /* No fit found. Get more memory and place the block */
+  extendsize = MAX(asize,CHUNKSIZE);
+  if ((bp = extend_heap(extendsize/WSIZE)) == NULL)
+    return NULL;
+  push(bp);
+  place(bp, asize);
+  return bp;
+}
+
+static void *find_fit(size_t asize)
+{
+  // "First-fit" policy:
+  for (char *bp = PTR(shm->free_list); bp != NULL; bp = PTR(GET_WORD(SUCC(bp))))
+    if (asize <= GET_SIZE(HDRP(bp)))
+      return bp;
+  return NULL;
+}
+
+static void place(void *bp, size_t asize)
+{
+  char *hdrp = HDRP(bp);
+  unsigned int pred = GET_WORD(PRED(bp));
+  unsigned int succ = GET_WORD(SUCC(bp));
+
+  size_t size = GET_SIZE(hdrp);
+  size_t diff = size - asize;
+
+  if (diff >= (2 * DSIZE)) {
+    // Split
+    // Allocate header
+    PUT_WORD(hdrp, PACK(asize, 1, 1));
+    // Write free block's metadata
+    char *next = NEXT_BLKP(bp);
+    PUT_WORD(HDRP(next), PACK(diff, 0, 1));
+    PUT_WORD(FTRP(next), PACK(diff, 0, 1));
+    PUT_WORD(SUCC(next), succ);
+    PUT_WORD(PRED(next), pred);
+    // Connect the free list back in place, not LIFO
+    if (pred != 0) PUT_WORD(SUCC(PTR(pred)), OFF(next));
+    else shm->free_list = OFF(next);
+    if (succ != 0) PUT_WORD(PRED(PTR(succ)), OFF(next));
+  } else {
+    // Allocate header
+    PUT_WORD(hdrp, PACK(size, 1, 1));
+    // Update the next block (allocated neighbor)
+    char *next = NEXT_BLKP(bp);
+    PUT_WORD(HDRP(next), PACK(GET_SIZE(HDRP(next)), 1, 1));
+    unlink_free(bp);
+  }
+}
+
+/*
+ * mm_free - Free and coalesce with free neighbors, under the heap lock.
+ *     Any process can free any block. Does nothing on a poisoned heap.
+ */
+void mm_free(void *ptr)
+{
+  if (shm_lock() == -1)
+    return;
+  free_locked(ptr);
+  pthread_mutex_unlock(&shm->lock);
+}
+
+static void free_locked(void *ptr)
+{
+  char *hdrp = HDRP(ptr);
+  size_t size = GET_SIZE(hdrp);
+  int prev_alloc = GET_PREV_ALLOC(hdrp);
+
+  PUT_WORD(HDRP(ptr), PACK(size, 0, prev_alloc));
+  PUT_WORD(FTRP(ptr), PACK(size, 0, prev_alloc));
+  push(coalesce(ptr));
+}
+
+static void *coalesce(void *bp)
+{
+  char *hdrp = HDRP(bp);
+  char *prev = PREV_BLKP(bp);
+  char *next = NEXT_BLKP(bp);
+  size_t prev_alloc = GET_PREV_ALLOC(hdrp);
+  size_t next_alloc = GET_ALLOC(HDRP(next));
+  size_t size = GET_SIZE(hdrp);
+
+  if (prev_alloc && next_alloc) {       /* Case 1 */
+    PUT_WORD(HDRP(next), PACK(GET_SIZE(HDRP(next)), next_alloc, 0));
+    return bp;
+  }
+
+  else if (prev_alloc && !next_alloc) { /* Case 2 */
+    size += GET_SIZE(HDRP(next));
+    PUT_WORD(HDRP(bp), PACK(size, 0, 1));
+    PUT_WORD(FTRP(bp), PACK(size,0, 1));
+
+    char *new_next = NEXT_BLKP(bp);
+    PUT_WORD(HDRP(new_next), PACK(GET_SIZE(HDRP(new_next)), 1, 0));
+    unlink_free(next);
+  }
+
+  else if (!prev_alloc && next_alloc) { /* Case 3 */
+    size += GET_SIZE(HDRP(prev));
+    PUT_WORD(FTRP(bp), PACK(size, 0, 1));
+    PUT_WORD(HDRP(prev), PACK(size, 0, 1));
+    bp = prev;
+
+    PUT_WORD(HDRP(next), PACK(GET_SIZE(HDRP(next)), next_alloc, 0));
+    unlink_free(prev);
+  }
+
+  else {                                /* Case 4 */
+    size += GET_SIZE(HDRP(prev)) + GET_SIZE(HDRP(next));
+    PUT_WORD(HDRP(prev), PACK(size, 0, 1));
+    PUT_WORD(FTRP(next), PACK(size, 0, 1));
+    bp = prev;
+
+    char *new_next = NEXT_BLKP(bp);
+    PUT_WORD(HDRP(new_next), PACK(GET_SIZE(HDRP(new_next)), 1, 0));
+    unlink_free(next);
+    unlink_free(prev);
+  }
+  return bp;
+}
+
+static void push(char *bp)
+{
+  // Connect to list using LIFO
+  if (shm->free_list != 0) PUT_WORD(PRED(PTR(shm->free_list)), OFF(bp));
+  PUT_WORD(SUCC(bp), shm->free_list);
+  PUT_WORD(PRED(bp), 0);
+  shm->free_list = OFF(bp);
+}
+
+static void unlink_free(char *bp)
+{
+  unsigned int pred = GET_WORD(PRED(bp));
+  unsigned int succ = GET_WORD(SUCC(bp));
+  if (pred != 0) PUT_WORD(SUCC(PTR(pred)), succ);
+  else shm->free_list = succ;
+  if (succ != 0) PUT_WORD(PRED(PTR(succ)), pred);
+}
+
+/*
+ * mm_realloc - Implemented in terms of malloc and free, in one critical
+ *     section so no other process sees the block half moved.
+ */
+void *mm_realloc(void *ptr, size_t size)
+{
+  void *newptr;
+  size_t copySize;
+
+  if (shm_lock() == -1)
+    return NULL;
+  if (ptr == NULL) {
+    newptr = malloc_locked(size);
+  } else if (size == 0) {
+    free_locked(ptr);
+    newptr = NULL;
+  } else if ((newptr = malloc_locked(size)) != NULL) {
+    copySize = GET_SIZE(HDRP(ptr)) - WSIZE;
+    if (size < copySize)
+      copySize = size;
+    memcpy(newptr, ptr, copySize);
+    free_locked(ptr);
+  }
+  pthread_mutex_unlock(&shm->lock);
+  return newptr;
+}
@@ -0,0 +1,17 @@
+/*
+ * mm_shm.h - Interfaces that mm_shared.c provides beyond mm.h.
+ */
+#ifndef MM_SHM_H
+#define MM_SHM_H
+
+#include <stddef.h>
+
+/* Make a heap of size bytes, under 4 GiB, in the shared memory object fd */
+extern int mm_shm_create (int fd, size_t size);
+/* Map a heap that another process made with mm_shm_create */
+extern int mm_shm_attach (int fd);
+/* Blocks change hands as offsets, which mean the same block in every mapping */
+extern unsigned int mm_shm_offset (void *ptr);
+extern void *mm_shm_pointer (unsigned int off);
+
+#endif